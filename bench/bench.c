@@ -0,0 +1,536 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE // required for wait4() and mkdtemp()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#endif
+
+/* hardware counters recorded for every run, when the kernel allows it */
+#define NUM_COUNTERS 3
+
+static const char *counter_names[NUM_COUNTERS] = {"cycles", "instructions", "cache_misses"};
+
+/* the measurements from running one program */
+struct run_result
+{
+    double wall;      // seconds
+    double user;
+    double sys;
+    long max_rss;     // KB
+    int status;       // exit status, or -1 if the program didn't exit normally
+    int have_counters;
+    unsigned long long counters[NUM_COUNTERS];
+};
+
+/* settings from the command line */
+struct options
+{
+    char *bin_dir;
+    char *work_dir;
+    char *out_file;
+    long zip_kb;
+    long wc_mb;
+    long cssh_commands;
+};
+
+void usage(void)
+{
+    fprintf(stderr, "usage: bench [-d bindir] [-w workdir] [-o out.json] [-z zip_kb] [-s wc_mb] [-n cssh_commands]\n");
+    fprintf(stderr, "       bindir: directory holding zip, unzip, wc, stats, and cssh (default .)\n");
+    fprintf(stderr, "       workdir: where to put the generated input files (default a new /tmp directory)\n");
+    fprintf(stderr, "       out.json: where to write the results (default stdout)\n");
+    fprintf(stderr, "       zip_kb: size of the zip input in KB (default 64)\n");
+    fprintf(stderr, "       wc_mb: size of the wc input in MB (default 64; use e.g. 4096 for multi-GB runs)\n");
+    fprintf(stderr, "       cssh_commands: number of commands cssh launches (default 1000)\n");
+    exit(1);
+}
+
+static double now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/* a small, fast pseudo-random generator so the input files are the same every run */
+static uint64_t next_random(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+/* fill buffer with size bytes of words and lines that look like text */
+static void fill_text(char *buffer, size_t size, uint64_t seed)
+{
+    static const char *words[] =
+    {
+        "the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog", "shell", "pipe",
+        "process", "file", "compress", "statistics", "count", "line", "word", "character",
+        "a", "of", "to", "and", "in", "is", "it", "that", "for", "on", "with", "as"
+    };
+    size_t num_words = sizeof(words) / sizeof(words[0]);
+    size_t i = 0;
+    int words_on_line = 0;
+    while (i < size)
+    {
+        const char *word = words[next_random(&seed) % num_words];
+        for (; *word != '\0' && i < size; ++word)
+        {
+            buffer[i++] = *word;
+        }
+        if (i < size)
+        {
+            buffer[i++] = ++words_on_line == 12 ? '\n' : ' ';
+            if (words_on_line == 12)
+            {
+                words_on_line = 0;
+            }
+        }
+    }
+}
+
+/* write size bytes of generated text to path, one chunk at a time
+ * return 0 on success and -1 on error
+ */
+static int write_text_file(char *path, long long size)
+{
+    size_t chunk_size = 1 << 20;
+    char *chunk = (char *)malloc(chunk_size);
+    if (chunk == NULL)
+    {
+        fprintf(stderr, "Memory error!\n");
+        return -1;
+    }
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1)
+    {
+        perror(path);
+        free(chunk);
+        return -1;
+    }
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    while (size > 0)
+    {
+        size_t n = size < (long long)chunk_size ? (size_t)size : chunk_size;
+        fill_text(chunk, n, next_random(&seed));
+        if (write(fd, chunk, n) != (ssize_t)n)
+        {
+            perror(path);
+            close(fd);
+            free(chunk);
+            return -1;
+        }
+        size -= n;
+    }
+    free(chunk);
+    if (close(fd) < 0)
+    {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+#ifdef __linux__
+/* open a counter of the given hardware event that follows pid and its children from exec on */
+static int open_counter(pid_t pid, unsigned long long config)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.enable_on_exec = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, pid, -1, -1, 0);
+}
+#endif
+
+/* run argv with stdin from in_path and stdout to out_path (either may be NULL)
+ * and fill in result
+ * return 0 on success, and -1 if the program couldn't be run or didn't exit with status 0
+ */
+int run_program(char **argv, char *in_path, char *out_path, struct run_result *result)
+{
+    memset(result, 0, sizeof(*result));
+
+    // the child waits on this pipe until the counters are attached to it
+    int go[2];
+    if (pipe(go) == -1)
+    {
+        perror("pipe");
+        return -1;
+    }
+    double start = now();
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        perror("fork");
+        close(go[0]);
+        close(go[1]);
+        return -1;
+    }
+    if (pid == 0)
+    {
+        char c;
+        close(go[1]);
+        while (read(go[0], &c, 1) == -1 && errno == EINTR)
+        {
+        }
+        close(go[0]);
+        int in = open(in_path != NULL ? in_path : "/dev/null", O_RDONLY);
+        int out = open(out_path != NULL ? out_path : "/dev/null", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (in == -1 || out == -1)
+        {
+            perror("open");
+            _exit(127);
+        }
+        dup2(in, STDIN_FILENO);
+        dup2(out, STDOUT_FILENO);
+        close(in);
+        close(out);
+        execv(argv[0], argv);
+        perror(argv[0]);
+        _exit(127);
+    }
+    close(go[0]);
+
+    int counter_fds[NUM_COUNTERS] = {-1, -1, -1};
+#ifdef __linux__
+    unsigned long long configs[NUM_COUNTERS] =
+    {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES
+    };
+    result->have_counters = 1;
+    for (int i = 0; i < NUM_COUNTERS; ++i)
+    {
+        counter_fds[i] = open_counter(pid, configs[i]);
+        if (counter_fds[i] == -1)
+        {
+            // no counters in this environment (permissions, containers, VMs)
+            result->have_counters = 0;
+        }
+    }
+#endif
+    close(go[1]);
+
+    int status;
+    struct rusage usage;
+    while (wait4(pid, &status, 0, &usage) == -1)
+    {
+        if (errno != EINTR)
+        {
+            perror("wait4");
+            return -1;
+        }
+    }
+    result->wall = now() - start;
+    result->user = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+    result->sys = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    result->max_rss = usage.ru_maxrss;
+    result->status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    for (int i = 0; i < NUM_COUNTERS; ++i)
+    {
+        if (counter_fds[i] == -1)
+        {
+            continue;
+        }
+        if (read(counter_fds[i], &result->counters[i], sizeof(result->counters[i])) != sizeof(result->counters[i]))
+        {
+            result->have_counters = 0;
+        }
+        close(counter_fds[i]);
+    }
+    // a run that failed or crashed didn't do the work being timed
+    if (WIFSIGNALED(status))
+    {
+        fprintf(stderr, "%s: killed by signal %d\n", argv[0], WTERMSIG(status));
+        return -1;
+    }
+    if (result->status != 0)
+    {
+        if (result->status != 127) // 127 means exec failed, which the child already reported
+        {
+            fprintf(stderr, "%s: exited with status %d\n", argv[0], result->status);
+        }
+        return -1;
+    }
+    return 0;
+}
+
+/* write one benchmark's results as a JSON object */
+void print_result(FILE *out, int first, char *name, char *params, char *metric_name, double metric,
+                  char *extra, struct run_result *result)
+{
+    fprintf(out, "%s\n    {\"name\": \"%s\", \"params\": {%s}, \"%s\": %.6g,%s"
+            " \"wall_s\": %.6f, \"user_s\": %.6f, \"sys_s\": %.6f, \"max_rss_kb\": %ld, \"exit\": %d",
+            first ? "" : ",", name, params, metric_name, metric, extra != NULL ? extra : "",
+            result->wall, result->user, result->sys, result->max_rss, result->status);
+    for (int i = 0; i < NUM_COUNTERS; ++i)
+    {
+        if (result->have_counters)
+        {
+            fprintf(out, ", \"%s\": %llu", counter_names[i], result->counters[i]);
+        }
+        else
+        {
+            fprintf(out, ", \"%s\": null", counter_names[i]);
+        }
+    }
+    fprintf(out, "}");
+}
+
+static long long file_size(char *path)
+{
+    struct stat st;
+    if (stat(path, &st) == -1)
+    {
+        return -1;
+    }
+    return st.st_size;
+}
+
+static long parse_count(char *s)
+{
+    char *end;
+    long n = strtol(s, &end, 10);
+    if (*s == '\0' || *end != '\0' || n < 1)
+    {
+        usage();
+    }
+    return n;
+}
+
+int main(int argc, char **argv)
+{
+    struct options opts = {".", NULL, NULL, 64, 64, 1000};
+    int opt;
+    while ((opt = getopt(argc, argv, "d:w:o:z:s:n:")) != -1)
+    {
+        if (opt == 'd')
+        {
+            opts.bin_dir = optarg;
+        }
+        else if (opt == 'w')
+        {
+            opts.work_dir = optarg;
+        }
+        else if (opt == 'o')
+        {
+            opts.out_file = optarg;
+        }
+        else if (opt == 'z')
+        {
+            opts.zip_kb = parse_count(optarg);
+        }
+        else if (opt == 's')
+        {
+            opts.wc_mb = parse_count(optarg);
+        }
+        else if (opt == 'n')
+        {
+            opts.cssh_commands = parse_count(optarg);
+        }
+        else
+        {
+            usage();
+        }
+    }
+    if (optind != argc)
+    {
+        usage();
+    }
+
+    char work_template[] = "/tmp/bench.XXXXXX";
+    if (opts.work_dir == NULL)
+    {
+        opts.work_dir = mkdtemp(work_template);
+        if (opts.work_dir == NULL)
+        {
+            perror("mkdtemp");
+            return 1;
+        }
+    }
+    FILE *out = stdout;
+    if (opts.out_file != NULL)
+    {
+        out = fopen(opts.out_file, "w");
+        if (out == NULL)
+        {
+            perror(opts.out_file);
+            return 1;
+        }
+    }
+
+    size_t dir_len = strlen(opts.bin_dir) + strlen(opts.work_dir) + 64;
+    char zip_path[dir_len], unzip_path[dir_len], wc_path[dir_len], stats_path[dir_len], cssh_path[dir_len];
+    char zip_input[dir_len], zip_output[dir_len], wc_input[dir_len], script[dir_len];
+    snprintf(zip_path, dir_len, "%s/zip", opts.bin_dir);
+    snprintf(unzip_path, dir_len, "%s/unzip", opts.bin_dir);
+    snprintf(wc_path, dir_len, "%s/wc", opts.bin_dir);
+    snprintf(stats_path, dir_len, "%s/stats", opts.bin_dir);
+    snprintf(cssh_path, dir_len, "%s/cssh", opts.bin_dir);
+    snprintf(zip_input, dir_len, "%s/zip_input.txt", opts.work_dir);
+    snprintf(zip_output, dir_len, "%s/zip_input.txt.zip", opts.work_dir);
+    snprintf(wc_input, dir_len, "%s/wc_input.txt", opts.work_dir);
+    snprintf(script, dir_len, "%s/cssh_script.sh", opts.work_dir);
+
+    struct run_result result;
+    char params[256];
+    char extra[128];
+    int first = 1;
+    int failed = 0;
+    fprintf(out, "{\n  \"benchmarks\": [");
+
+    // zip and unzip: throughput and compression ratio on generated text, without and
+    // with the Huffman coded second stage
+    char *zip_modes[] = {NULL, "-h"};
+    char *zip_names[] = {"zip", "zip_huffman"};
+    char *unzip_names[] = {"unzip", "unzip_huffman"};
+    for (int mode = 0; mode < 2; ++mode)
+    {
+        if (write_text_file(zip_input, opts.zip_kb * 1024) != 0)
+        {
+            failed = 1;
+            break;
+        }
+        double in_size = opts.zip_kb * 1024.0;
+        snprintf(params, sizeof(params), "\"input_bytes\": %.0f", in_size);
+        char *zip_argv[] = {zip_path, zip_input, NULL, NULL};
+        if (zip_modes[mode] != NULL)
+        {
+            zip_argv[1] = zip_modes[mode];
+            zip_argv[2] = zip_input;
+        }
+        if (run_program(zip_argv, NULL, NULL, &result) == 0)
+        {
+            snprintf(extra, sizeof(extra), " \"ratio\": %.4f,", file_size(zip_output) / in_size);
+            print_result(out, first, zip_names[mode], params, "mb_per_s", in_size / 1e6 / result.wall,
+                         extra, &result);
+            first = 0;
+            unlink(zip_input);
+
+            // unzip recreates zip_input from zip_output; throughput is of the uncompressed bytes
+            char *unzip_argv[] = {unzip_path, zip_output, NULL};
+            if (run_program(unzip_argv, NULL, NULL, &result) == 0 && file_size(zip_input) == in_size)
+            {
+                print_result(out, first, unzip_names[mode], params, "mb_per_s",
+                             in_size / 1e6 / result.wall, NULL, &result);
+            }
+            else
+            {
+                failed = 1;
+            }
+        }
+        else
+        {
+            failed = 1;
+        }
+        unlink(zip_output);
+        unlink(zip_input);
+    }
+
+    // wc: throughput on a large generated text file
+    if (write_text_file(wc_input, opts.wc_mb * 1024 * 1024LL) == 0)
+    {
+        char *wc_argv[] = {wc_path, wc_input, NULL};
+        if (run_program(wc_argv, NULL, NULL, &result) == 0)
+        {
+            double in_size = opts.wc_mb * 1024.0 * 1024.0;
+            snprintf(params, sizeof(params), "\"input_bytes\": %.0f", in_size);
+            print_result(out, first, "wc", params, "gb_per_s", in_size / 1e9 / result.wall, NULL, &result);
+            first = 0;
+        }
+        else
+        {
+            failed = 1;
+        }
+        unlink(wc_input);
+    }
+    else
+    {
+        failed = 1;
+    }
+
+    // stats: values generated and summarized per second at several population sizes
+    const char *populations[] = {"1000", "100000", "1000000"};
+    for (size_t i = 0; i < sizeof(populations) / sizeof(populations[0]); ++i)
+    {
+        char *stats_argv[] = {stats_path, "10", (char *)populations[i], "1", "1000", NULL};
+        if (run_program(stats_argv, NULL, NULL, &result) == 0)
+        {
+            snprintf(params, sizeof(params), "\"samples\": 10, \"population\": %s", populations[i]);
+            print_result(out, first, "stats", params, "values_per_s",
+                         10 * atof(populations[i]) / result.wall, NULL, &result);
+            first = 0;
+        }
+        else
+        {
+            failed = 1;
+        }
+    }
+
+    // cssh: average latency of a trivial external command, and of a builtin
+    const char *commands[] = {"true", "pwd"};
+    const char *names[] = {"cssh_spawn", "cssh_builtin"};
+    for (int i = 0; i < 2; ++i)
+    {
+        FILE *f = fopen(script, "w");
+        if (f == NULL)
+        {
+            perror(script);
+            failed = 1;
+            continue;
+        }
+        for (long j = 0; j < opts.cssh_commands; ++j)
+        {
+            fprintf(f, "%s\n", commands[i]);
+        }
+        fclose(f);
+        char *cssh_argv[] = {cssh_path, script, NULL};
+        if (run_program(cssh_argv, NULL, NULL, &result) == 0)
+        {
+            snprintf(params, sizeof(params), "\"command\": \"%s\", \"commands\": %ld", commands[i],
+                     opts.cssh_commands);
+            print_result(out, first, (char *)names[i], params, "latency_us",
+                         result.wall * 1e6 / opts.cssh_commands, NULL, &result);
+            first = 0;
+        }
+        else
+        {
+            failed = 1;
+        }
+        unlink(script);
+    }
+
+    fprintf(out, "\n  ]\n}\n");
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    if (opts.work_dir == work_template)
+    {
+        rmdir(opts.work_dir);
+    }
+    return failed;
+}
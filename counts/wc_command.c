@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "wc_command.h"
+
+/* size of the buffer the input is read into */
+#define READ_SIZE 65536
+
+/* print msg and the usage message to out, and return the exit status for a usage error */
+static int print_usage(FILE *out, char *msg);
+
+/* store the number of lines, words, and characters in filename in counts */
+/* should pass in a filename of "" to indicate to read from in */
+/* return 0 on success and -1 on error */
+static int get_counts(char *filename, int in, long long *counts);
+
+/* print the indicated counts for file name to out */
+/* show should be an array of three ints that indicates if the number of lines,
+ * words, and characters should be printed */
+/* count is an array of the three counts */
+/* name is the name to print after the counts */
+static void print_counts(FILE *out, int *show, long long *count, char *name);
+
+int wc_command(int argc, char **argv, int in, FILE *out)
+{
+    int first_filename = 1; // index of the first filename
+    int use_stdin = 0; // turns to 1 to indicate that we're reading from standard input
+    int to_display[] = {0, 0, 0}; // indicates which counts are to be printed
+    if (argc == 1)
+    {
+        use_stdin = 1;
+    }
+    // iterate through command line, break when first filename is found
+    for (int i = 1; i < argc; i++)
+    {
+        if (argv[i][0] != '-')
+        {
+            first_filename = i;
+            break;
+        }
+        if (i == argc-1)
+        {
+            use_stdin = 1;
+        }
+        if (strcmp(argv[i], "-l") != 0 && strcmp(argv[i], "-w") != 0  && strcmp(argv[i], "-c") != 0)
+        {
+            return print_usage(out, "invalid argument");
+        }
+        if (strcmp(argv[i], "-l") == 0)
+        {
+            to_display[0] = 1;
+        }
+        if (strcmp(argv[i], "-w") == 0)
+        {
+            to_display[1] = 1;
+        }
+        if (strcmp(argv[i], "-c") == 0)
+        {
+            to_display[2] = 1;
+        }
+    }
+    if (to_display[0] == 0 && to_display[1] == 0 && to_display[2] == 0)
+    {
+        to_display[0] = 1;
+        to_display[1] = 1;
+        to_display[2] = 1;
+    }
+    if (use_stdin == 1)
+    {
+        long long three_counts[] = {0, 0, 0};
+        if (get_counts("", in, three_counts) != 0)
+        {
+            fprintf(out, "Failed to get counts from standard input\n");
+            return 1;
+        }
+        print_counts(out, to_display, three_counts, "");
+    }
+    else
+    {
+        long long totals[] = {0, 0, 0};
+        for (int i = first_filename; i < argc; i++)
+        {
+            long long three_counts[] = {0, 0, 0};
+            if (get_counts(argv[i], in, three_counts) != 0)
+            {
+                continue;
+            }
+            print_counts(out, to_display, three_counts, argv[i]);
+            totals[0] += three_counts[0];
+            totals[1] += three_counts[1];
+            totals[2] += three_counts[2];
+        }
+        if (argc > first_filename + 1)
+        {
+            print_counts(out, to_display, totals, "total");
+        }
+    }
+    return 0;
+}
+
+static int print_usage(FILE *out, char *msg)
+{
+    if (msg != NULL)
+    {
+        fprintf(out, "%s\n", msg);
+    }
+    fprintf(out, "\nUsage: wc [-l] [-w] [-c] [FILES...]\n");
+    fprintf(out, "where:\n");
+    fprintf(out, "       -l    prints the number of lines\n");
+    fprintf(out, "       -w    prints the number of words\n");
+    fprintf(out, "       -c    prints the number of characters\n");
+    fprintf(out, "       FILES if no files are given, then read\n");
+    fprintf(out, "             from standard input\n");
+    return 1;
+}
+
+static int get_counts(char *filename, int in, long long *counts)
+{
+    int fd;
+    if (strcmp(filename, "") == 0)
+    {
+        fd = in;
+    }
+    else
+    {
+        fd = open(filename, O_RDONLY);
+        if (fd == -1)
+        {
+            perror(filename);
+            return -1;
+        }
+    }
+    unsigned char buffer[READ_SIZE];
+    ssize_t successfully_read;
+    int in_whitespace = 1;
+    while ((successfully_read = read(fd, buffer, READ_SIZE)) > 0)
+    {
+        for (ssize_t i = 0; i < successfully_read; i++)
+        {
+            if (buffer[i] == '\n')
+            {
+                counts[0]++;
+            }
+            if (isspace(buffer[i]))
+            {
+                if (!in_whitespace)
+                {
+                    counts[1]++;
+                    in_whitespace = 1;
+                }
+            }
+            else
+            {
+                in_whitespace = 0;
+            }
+        }
+        counts[2] += successfully_read;
+    }
+    if (successfully_read == -1)
+    {
+        perror(filename);
+        if (fd != in)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+    if (!in_whitespace)
+    {
+        counts[1]++;
+    }
+    if (fd != in)
+    {
+        close(fd);
+    }
+    return 0;
+}
+
+static void print_counts(FILE *out, int *show, long long *count, char *name)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        if (show[i])
+        {
+            fprintf(out, "%8lld ", count[i]);
+        }
+    }
+    fprintf(out, "%s\n", name);
+}
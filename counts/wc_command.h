@@ -0,0 +1,12 @@
+#ifndef WC_COMMAND_H
+#define WC_COMMAND_H
+
+#include <stdio.h>
+
+/* run the wc command with the given arguments, reading stdin from in and printing to out
+ * shared by the wc program and the cssh builtin, so errors are returned rather than exit()ed
+ * return the command's exit status
+ */
+int wc_command(int argc, char **argv, int in, FILE *out);
+
+#endif
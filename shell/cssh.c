@@ -1,6 +1,5 @@
 #define _POSIX_C_SOURCE 200809L // required for strdup() on cslab
-#define _DEFAULT_SOURCE // required for strsep() on cslab
-#define _BSD_SOURCE // required for strsep() on cslab
+#define _DEFAULT_SOURCE // required for wait4() on cslab
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -11,101 +10,394 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <string.h>
+#include <spawn.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "../counts/wc_command.h"
+#include "../stats/stats_command.h"
 
-#define MAX_ARGS 32
+/* initial number of tokens a command has room for; it grows as needed */
+#define INITIAL_TOKENS 32
 
-char **get_next_command(size_t *num_args)
+/* what each token in a command is */
+enum token_kind
 {
-    // print the prompt
-    printf("cssh$ ");
+    TOKEN_WORD,
+    TOKEN_PIPE,       // |
+    TOKEN_INPUT,      // <
+    TOKEN_OUTPUT,     // >
+    TOKEN_APPEND,     // >>
+    TOKEN_BACKGROUND  // &
+};
 
-    // get the next line of input
-    char *line = NULL;
-    size_t len = 0;
-    getline(&line, &len, stdin);
-    if (ferror(stdin))
+/* one line of input split into tokens
+ * the words point into line itself, and every buffer here is reused from
+ * one line to the next, so tokenizing a line doesn't allocate per word
+ */
+struct command
+{
+    char *line;
+    size_t line_size;
+    char **words;     // operators point at a string constant such as "|"
+    int *kinds;       // enum token_kind for each word
+    size_t num_words;
+    size_t capacity;
+};
+
+/* the files a command's stdin and stdout are redirected to, or NULL */
+struct redirection
+{
+    char *input;
+    char *output;
+    int append;   // open output with O_APPEND (>>) instead of O_TRUNC (>)
+};
+
+/* a command the shell runs itself instead of starting a new program
+ * run gets the input and output fds to use in place of stdin and stdout
+ * and returns the command's exit status
+ */
+struct builtin
+{
+    char *name;
+    int (*run)(size_t argc, char **argv, int in, int out);
+    int optional; // only used when cssh is run with -b
+};
+
+/* number of buckets in the cache of resolved PATH lookups */
+#define PATH_CACHE_SIZE 64
+
+extern char **environ;
+
+/* a command name and the executable it resolved to on PATH */
+struct path_entry
+{
+    char *name;
+    char *path;
+    struct path_entry *next;
+};
+
+static struct path_entry *path_cache[PATH_CACHE_SIZE];
+
+/* number of exited children the SIGCHLD handler can hold before the shell collects them */
+#define MAX_REAPED 1024
+
+/* a pipeline started by the shell */
+struct job
+{
+    int id;
+    char *command;   // the command line, for jobs/fg and tracing, or NULL if nothing shows it
+    pid_t *pids;     // one process per pipeline stage the shell started
+    size_t num_pids;
+    size_t num_stages;  // stages in the pipeline, counting any builtin or stage that didn't start
+    size_t running;  // stages that haven't exited yet
+    int status;      // wait status of the last stage
+    int last_started; // 0 if the last stage wasn't a started process, and status is the shell's
+    int background;
+    struct timespec start;
+    struct timespec end;   // when the last stage exited
+    struct timeval user;   // CPU time summed over all stages
+    struct timeval sys;
+    long max_rss;          // largest peak RSS (KB) of any stage
+    struct job *next;
+};
+
+static struct job *jobs;
+
+/* set when commands come from the terminal rather than -c or a script */
+static int interactive = 1;
+
+/* exit status of the last foreground command */
+static int last_status;
+
+/* set by the exit builtin */
+static int exit_requested;
+
+/* set by -b to run wc and stats inside the shell */
+static int use_optional_builtins;
+
+/* where to write per-command resource records, or NULL if tracing is off */
+static FILE *trace_file;
+
+/* children reaped by the SIGCHLD handler but not yet matched to their jobs */
+static volatile sig_atomic_t num_reaped;
+static pid_t reaped_pids[MAX_REAPED];
+static int reaped_status[MAX_REAPED];
+static struct rusage reaped_usage[MAX_REAPED];
+static struct timespec reaped_time[MAX_REAPED];
+
+/* append a token to cmd, growing its arrays if needed
+ * return 0 on success and -1 if out of memory
+ */
+static int add_token(struct command *cmd, char *word, int kind)
+{
+    if (cmd->num_words + 1 >= cmd->capacity)
+    {
+        size_t capacity = cmd->capacity == 0 ? INITIAL_TOKENS : cmd->capacity * 2;
+        char **words = (char **)realloc(cmd->words, capacity * sizeof(char *));
+        if (words == NULL)
+        {
+            return -1;
+        }
+        cmd->words = words;
+        int *kinds = (int *)realloc(cmd->kinds, capacity * sizeof(int));
+        if (kinds == NULL)
+        {
+            return -1;
+        }
+        cmd->kinds = kinds;
+        cmd->capacity = capacity;
+    }
+    cmd->words[cmd->num_words] = word;
+    cmd->kinds[cmd->num_words] = kind;
+    cmd->num_words++;
+    cmd->words[cmd->num_words] = NULL;
+    return 0;
+}
+
+/* if c (followed by next) starts an operator, store its kind and text
+ * return the operator's length, or 0 if c isn't an operator
+ */
+static int operator_length(char c, char next, int *kind, char **text)
+{
+    if (c == '|')
     {
-        perror("getline");
-        exit(1);
+        *kind = TOKEN_PIPE;
+        *text = "|";
+        return 1;
     }
-    if (feof(stdin))
+    if (c == '<')
     {
-        return NULL;
+        *kind = TOKEN_INPUT;
+        *text = "<";
+        return 1;
+    }
+    if (c == '>' && next == '>')
+    {
+        *kind = TOKEN_APPEND;
+        *text = ">>";
+        return 2;
+    }
+    if (c == '>')
+    {
+        *kind = TOKEN_OUTPUT;
+        *text = ">";
+        return 1;
+    }
+    if (c == '&')
+    {
+        *kind = TOKEN_BACKGROUND;
+        *text = "&";
+        return 1;
     }
+    return 0;
+}
 
-    // turn the line into an array of words
-    char **words = (char **)malloc(MAX_ARGS * sizeof(char *));
-    int i = 0;
+static int is_blank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\n' || c == '\v';
+}
 
-    char *parse = line;
-    while (parse != NULL)
+/* split cmd->line into tokens in place
+ * quotes and backslashes are removed as the words are copied down over
+ * themselves, which is safe because a word never gets longer than its source
+ * return 0 on success and -1 on a syntax error
+ */
+int tokenize(struct command *cmd)
+{
+    char *r = cmd->line; // next character to read
+    int kind;
+    char *text;
+    cmd->num_words = 0;
+    while (1)
     {
-        char *word = strsep(&parse, " \t\r\f\n");
-        if (strlen(word) != 0)
+        while (is_blank(*r))
         {
-            words[i++] = strdup(word);
+            r++;
+        }
+        if (*r == '\0' || *r == '#')
+        {
+            // end of line, or the rest of the line is a comment
+            break;
+        }
+        int length = operator_length(r[0], r[1], &kind, &text);
+        if (length > 0)
+        {
+            if (add_token(cmd, text, kind) != 0)
+            {
+                fprintf(stderr, "Memory error!\n");
+                return -1;
+            }
+            r += length;
+            continue;
         }
-    }
-    *num_args = i;
-    for (; i < MAX_ARGS; ++i)
-    {
-        words[i] = NULL;
-    }
 
-    // all the words are in the array now, so free the original line
-    free(line);
+        // a word: copy it down to w, dropping quotes and escapes
+        char *word = r;
+        char *w = r;
+        while (*r != '\0' && !is_blank(*r) && operator_length(r[0], r[1], &kind, &text) == 0)
+        {
+            if (*r == '\'')
+            {
+                // everything up to the next ' is literal
+                r++;
+                while (*r != '\'' && *r != '\0')
+                {
+                    *w++ = *r++;
+                }
+                if (*r == '\0')
+                {
+                    fprintf(stderr, "Error! Unterminated '!\n");
+                    return -1;
+                }
+                r++;
+            }
+            else if (*r == '"')
+            {
+                // only \" \\ \$ and \` are escapes inside double quotes
+                r++;
+                while (*r != '"' && *r != '\0')
+                {
+                    if (*r == '\\' && (r[1] == '"' || r[1] == '\\' || r[1] == '$' || r[1] == '`'))
+                    {
+                        r++;
+                    }
+                    *w++ = *r++;
+                }
+                if (*r == '\0')
+                {
+                    fprintf(stderr, "Error! Unterminated \"!\n");
+                    return -1;
+                }
+                r++;
+            }
+            else if (*r == '\\' && r[1] == '\n')
+            {
+                // a backslash at the end of the line is dropped
+                r += 2;
+            }
+            else if (*r == '\\' && r[1] != '\0')
+            {
+                r++;
+                *w++ = *r++;
+            }
+            else
+            {
+                *w++ = *r++;
+            }
+        }
 
-    return words;
+        // w may have caught up with r, so save the character that ended the word first
+        char end = r[0];
+        char after = end == '\0' ? '\0' : r[1];
+        *w = '\0';
+        if (add_token(cmd, word, TOKEN_WORD) != 0)
+        {
+            fprintf(stderr, "Memory error!\n");
+            return -1;
+        }
+        if (end == '\0')
+        {
+            break;
+        }
+        length = operator_length(end, after, &kind, &text);
+        if (length > 0)
+        {
+            if (add_token(cmd, text, kind) != 0)
+            {
+                fprintf(stderr, "Memory error!\n");
+                return -1;
+            }
+            r += length;
+        }
+        else
+        {
+            r++;
+        }
+    }
+    return 0;
 }
 
-void free_command(char **words)
+/* read the next command from input into cmd, printing a prompt first if prompt is set
+ * return 0 at the end of input; a line that can't be parsed gives a command with no words
+ */
+int get_next_command(FILE *input, int prompt, struct command *cmd)
 {
-    for (int i = 0; i < MAX_ARGS; ++i)
+    // print the prompt
+    if (prompt)
+    {
+        printf("cssh$ ");
+    }
+
+    // get the next line of input
+    if (getline(&cmd->line, &cmd->line_size, input) == -1)
     {
-        if (words[i] == NULL)
+        if (ferror(input))
         {
-            break;
+            perror("getline");
+            exit(1);
         }
-        free(words[i]);
+        return 0;
+    }
+
+    // turn the line into an array of tokens
+    if (tokenize(cmd) != 0)
+    {
+        cmd->num_words = 0;
+        last_status = 1;
     }
-    free(words);
+    return 1;
 }
 
-int handle_redirection(char **command_line_words, size_t *num_args)
+void free_command(struct command *cmd)
 {
-    int input_fd = -1, output_fd = -1;
+    free(cmd->line);
+    free(cmd->words);
+    free(cmd->kinds);
+}
+
+/* copy the words of one command into argv, leaving out the redirections,
+ * and record the files they name in redirect
+ * argv must have room for num_args + 1 entries
+ */
+int handle_redirection(char **command_line_words, int *kinds, size_t num_args, char **argv,
+                       struct redirection *redirect)
+{
+    redirect->input = NULL;
+    redirect->output = NULL;
+    redirect->append = 0;
     int input_count = 0, output_count = 0;
     int redirection_type = 0; // 1 for >, 2 for >>
+    size_t argc = 0;
 
-    for (size_t i = 0; i < *num_args; ++i)
+    for (size_t i = 0; i < num_args; ++i)
     {
-        if (command_line_words[i] == NULL)
-            break;
+        int is_input = kinds[i] == TOKEN_INPUT;
+        int is_truncate = kinds[i] == TOKEN_OUTPUT;
+        int is_append = kinds[i] == TOKEN_APPEND;
+        if (!is_input && !is_truncate && !is_append)
+        {
+            argv[argc++] = command_line_words[i];
+            continue;
+        }
+        if (i + 1 >= num_args || kinds[i + 1] != TOKEN_WORD)
+        {
+            fprintf(stderr, "Error! Missing file name after %s!\n", command_line_words[i]);
+            return -1;
+        }
+        char *file_name = command_line_words[++i];
 
-        if (strcmp(command_line_words[i], "<") == 0)
+        if (is_input)
         {
             if (++input_count > 1)
             {
                 fprintf(stderr, "Error! Can't have two <'s!\n");
                 return -1;
             }
-            input_fd = open(command_line_words[i + 1], O_RDONLY);
-            if (input_fd == -1)
-            {
-                perror("open");
-                return -1;
-            }
-            dup2(input_fd, STDIN_FILENO);
-            close(input_fd);
-            // Shift the remaining arguments
-            for (size_t j = i; j + 2 < *num_args; ++j)
-            {
-                command_line_words[j] = command_line_words[j + 2];
-            }
-            *num_args -= 2;
-            i--;
+            redirect->input = file_name;
         }
-        else if (strcmp(command_line_words[i], ">") == 0)
+        else if (is_truncate)
         {
             if (++output_count > 1 || redirection_type == 2)
             {
@@ -113,23 +405,9 @@ int handle_redirection(char **command_line_words, size_t *num_args)
                 return -1;
             }
             redirection_type = 1;
-            output_fd = open(command_line_words[i + 1], O_WRONLY | O_CREAT | O_TRUNC, 0644);
-            if (output_fd == -1)
-            {
-                perror("open");
-                return -1;
-            }
-            dup2(output_fd, STDOUT_FILENO);
-            close(output_fd);
-            // Shift the remaining arguments
-            for (size_t j = i; j + 2 < *num_args; ++j)
-            {
-                command_line_words[j] = command_line_words[j + 2];
-            }
-            *num_args -= 2;
-            i--;
+            redirect->output = file_name;
         }
-        else if (strcmp(command_line_words[i], ">>") == 0)
+        else
         {
             if (++output_count > 1 || redirection_type == 1)
             {
@@ -137,79 +415,1316 @@ int handle_redirection(char **command_line_words, size_t *num_args)
                 return -1;
             }
             redirection_type = 2;
-            output_fd = open(command_line_words[i + 1], O_WRONLY | O_CREAT | O_APPEND, 0644);
-            if (output_fd == -1)
+            redirect->output = file_name;
+            redirect->append = 1;
+        }
+    }
+
+    if (argc == 0)
+    {
+        fprintf(stderr, "Error! Missing command!\n");
+        return -1;
+    }
+    argv[argc] = NULL; // Null-terminate the cleaned array
+
+    return 0;
+}
+
+/* open the files in redirect, storing their fds in *input_fd and *output_fd (-1 if not redirected)
+ * the fds are close-on-exec, so only a child that dup2()s them keeps them
+ * return 0 on success and -1, after naming the file that failed, on error
+ */
+int open_redirection(struct redirection *redirect, int *input_fd, int *output_fd)
+{
+    *input_fd = -1;
+    *output_fd = -1;
+    if (redirect->input != NULL)
+    {
+        *input_fd = open(redirect->input, O_RDONLY | O_CLOEXEC);
+        if (*input_fd == -1)
+        {
+            perror(redirect->input);
+            return -1;
+        }
+    }
+    if (redirect->output != NULL)
+    {
+        int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (redirect->append ? O_APPEND : O_TRUNC);
+        *output_fd = open(redirect->output, flags, 0644);
+        if (*output_fd == -1)
+        {
+            perror(redirect->output);
+            if (*input_fd != -1)
             {
-                perror("open");
-                return -1;
+                close(*input_fd);
+                *input_fd = -1;
             }
-            dup2(output_fd, STDOUT_FILENO);
-            close(output_fd);
-            // Shift the remaining arguments
-            for (size_t j = i; j + 2 < *num_args; ++j)
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static unsigned int path_hash(char *name)
+{
+    unsigned int h = 5381;
+    for (; *name != '\0'; ++name)
+    {
+        h = h * 33 + (unsigned char)*name;
+    }
+    return h % PATH_CACHE_SIZE;
+}
+
+/* forget every cached PATH lookup */
+void clear_path_cache(void)
+{
+    for (int i = 0; i < PATH_CACHE_SIZE; ++i)
+    {
+        struct path_entry *entry = path_cache[i];
+        while (entry != NULL)
+        {
+            struct path_entry *next = entry->next;
+            free(entry->name);
+            free(entry->path);
+            free(entry);
+            entry = next;
+        }
+        path_cache[i] = NULL;
+    }
+}
+
+/* forget the cached PATH lookup for name, if there is one */
+void forget_path(char *name)
+{
+    struct path_entry **link = &path_cache[path_hash(name)];
+    while (*link != NULL)
+    {
+        if (strcmp((*link)->name, name) == 0)
+        {
+            struct path_entry *entry = *link;
+            *link = entry->next;
+            free(entry->name);
+            free(entry->path);
+            free(entry);
+            return;
+        }
+        link = &(*link)->next;
+    }
+}
+
+/* forget the cached PATH lookups that were found through a relative PATH entry */
+void forget_relative_paths(void)
+{
+    for (int i = 0; i < PATH_CACHE_SIZE; ++i)
+    {
+        struct path_entry *entry = path_cache[i];
+        while (entry != NULL)
+        {
+            struct path_entry *next = entry->next;
+            if (entry->path[0] != '/')
             {
-                command_line_words[j] = command_line_words[j + 2];
+                forget_path(entry->name);
             }
-            *num_args -= 2;
-            i--;
+            entry = next;
+        }
+    }
+}
+
+/* print every cached PATH lookup to out */
+void print_path_cache(int out)
+{
+    for (int i = 0; i < PATH_CACHE_SIZE; ++i)
+    {
+        for (struct path_entry *entry = path_cache[i]; entry != NULL; entry = entry->next)
+        {
+            dprintf(out, "%s\t%s\n", entry->name, entry->path);
         }
     }
+}
 
-    command_line_words[*num_args] = NULL; // Null-terminate the cleaned array
+/* find the executable for name the way execvp() would, remembering the result
+ * return NULL if name isn't found on PATH
+ * the returned string belongs to the cache (or is name itself)
+ */
+char *resolve_command(char *name)
+{
+    if (strchr(name, '/') != NULL)
+    {
+        return name;
+    }
+    unsigned int bucket = path_hash(name);
+    for (struct path_entry *entry = path_cache[bucket]; entry != NULL; entry = entry->next)
+    {
+        if (strcmp(entry->name, name) == 0)
+        {
+            return entry->path;
+        }
+    }
 
-    return 0;
+    char *path_var = getenv("PATH");
+    if (path_var == NULL)
+    {
+        path_var = "/bin:/usr/bin";
+    }
+    size_t name_len = strlen(name);
+    char *candidate = (char *)malloc(strlen(path_var) + name_len + 2);
+    if (candidate == NULL)
+    {
+        return NULL;
+    }
+    char *dir = path_var;
+    while (1)
+    {
+        char *colon = strchr(dir, ':');
+        size_t dir_len = colon == NULL ? strlen(dir) : (size_t)(colon - dir);
+        if (dir_len == 0)
+        {
+            // an empty PATH entry means the current directory
+            candidate[0] = '.';
+            dir_len = 1;
+        }
+        else
+        {
+            memcpy(candidate, dir, dir_len);
+        }
+        candidate[dir_len] = '/';
+        memcpy(candidate + dir_len + 1, name, name_len + 1);
+
+        struct stat st;
+        if (stat(candidate, &st) == 0 && S_ISREG(st.st_mode) && access(candidate, X_OK) == 0)
+        {
+            struct path_entry *entry = (struct path_entry *)malloc(sizeof(struct path_entry));
+            char *cached_name = strdup(name);
+            char *cached_path = strdup(candidate);
+            free(candidate);
+            if (entry == NULL || cached_name == NULL || cached_path == NULL)
+            {
+                free(entry);
+                free(cached_name);
+                free(cached_path);
+                return NULL;
+            }
+            entry->name = cached_name;
+            entry->path = cached_path;
+            entry->next = path_cache[bucket];
+            path_cache[bucket] = entry;
+            return cached_path;
+        }
+        if (colon == NULL)
+        {
+            break;
+        }
+        dir = colon + 1;
+    }
+    free(candidate);
+    return NULL;
 }
 
-void execute_command(char **command_line_words, size_t num_args)
+/* run a file the kernel won't execute (a script without #!) with /bin/sh, as execvp() does
+ * return the new process's pid, or -1 if it couldn't be started
+ */
+static pid_t spawn_shell_script(char *path, char **argv, posix_spawn_file_actions_t *actions,
+                                posix_spawnattr_t *attr)
 {
-    pid_t pid = fork();
-    if (pid == -1)
+    size_t argc = 0;
+    while (argv[argc] != NULL)
+    {
+        argc++;
+    }
+    char **sh_argv = (char **)malloc((argc + 2) * sizeof(char *));
+    if (sh_argv == NULL)
+    {
+        fprintf(stderr, "Memory error!\n");
+        return -1;
+    }
+    sh_argv[0] = "sh";
+    sh_argv[1] = path;
+    memcpy(sh_argv + 2, argv + 1, argc * sizeof(char *)); // the rest of the args and the NULL
+    pid_t pid;
+    int err = posix_spawn(&pid, "/bin/sh", actions, attr, sh_argv, environ);
+    free(sh_argv);
+    if (err != 0)
     {
-        perror("fork");
-        exit(EXIT_FAILURE);
+        fprintf(stderr, "%s: %s\n", argv[0], strerror(err));
+        return -1;
     }
-    else if (pid == 0)
+    return pid;
+}
+
+/* spawn the command in argv with the given file actions
+ * return the new process's pid, or -1 if it couldn't be started, with *failure
+ * set to the exit status sh would give it (127 if not found, 126 if not runnable)
+ */
+pid_t spawn_command(char **argv, posix_spawn_file_actions_t *actions, posix_spawnattr_t *attr,
+                    int *failure)
+{
+    *failure = 127;
+    for (int attempt = 0; attempt < 2; ++attempt)
     {
-        // Handle I/O redirection
-        if (handle_redirection(command_line_words, &num_args) != 0)
+        char *path = resolve_command(argv[0]);
+        if (path == NULL)
+        {
+            fprintf(stderr, "%s: command not found\n", argv[0]);
+            return -1;
+        }
+        pid_t pid;
+        int err = posix_spawn(&pid, path, actions, attr, argv, environ);
+        if (err == 0)
+        {
+            return pid;
+        }
+        if (err == ENOEXEC)
         {
-            exit(EXIT_FAILURE);
+            *failure = 126;
+            return spawn_shell_script(path, argv, actions, attr);
         }
+        if (path != argv[0] && access(path, X_OK) != 0)
+        {
+            // the cached executable went away, so look it up again
+            forget_path(argv[0]);
+            continue;
+        }
+        fprintf(stderr, "%s: %s\n", argv[0], strerror(err));
+        *failure = err == ENOENT ? 127 : 126;
+        return -1;
+    }
+    fprintf(stderr, "%s: command not found\n", argv[0]);
+    return -1;
+}
 
-        execvp(command_line_words[0], command_line_words);
-        perror("execvp");
-        exit(EXIT_FAILURE);
+/* reap every exited child without blocking, so zombies never pile up while
+ * the shell is busy or waiting for input; the pids are matched to their
+ * jobs later by collect_children()
+ */
+static void handle_sigchld(int sig)
+{
+    (void)sig;
+    int saved_errno = errno;
+    pid_t pid;
+    int status;
+    while (num_reaped < MAX_REAPED
+           && (pid = wait4(-1, &status, WNOHANG, &reaped_usage[num_reaped])) > 0)
+    {
+        reaped_pids[num_reaped] = pid;
+        reaped_status[num_reaped] = status;
+        clock_gettime(CLOCK_MONOTONIC, &reaped_time[num_reaped]);
+        num_reaped++;
     }
-    else
+    errno = saved_errno;
+}
+
+static void add_timeval(struct timeval *total, struct timeval *t)
+{
+    total->tv_sec += t->tv_sec;
+    total->tv_usec += t->tv_usec;
+    if (total->tv_usec >= 1000000)
     {
-        int status;
-        waitpid(pid, &status, 0);
+        total->tv_sec++;
+        total->tv_usec -= 1000000;
     }
 }
 
-int main()
+static int is_later(struct timespec *a, struct timespec *b)
 {
-    size_t num_args;
+    return a->tv_sec > b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec > b->tv_nsec);
+}
 
-    // get the next command
-    char **command_line_words = get_next_command(&num_args);
-    while (command_line_words != NULL)
+/* record that pid exited with status in the job it belongs to */
+static void mark_exited(pid_t pid, int status, struct rusage *usage, struct timespec *when)
+{
+    for (struct job *job = jobs; job != NULL; job = job->next)
     {
-        if (num_args > 0)
+        for (size_t i = 0; i < job->num_pids; ++i)
         {
-            if (strcmp(command_line_words[0], "exit") == 0)
+            if (job->pids[i] == pid)
             {
-                free_command(command_line_words);
-                break;
+                job->running--;
+                if (i == job->num_pids - 1 && job->last_started)
+                {
+                    job->status = status;
+                }
+                add_timeval(&job->user, &usage->ru_utime);
+                add_timeval(&job->sys, &usage->ru_stime);
+                if (usage->ru_maxrss > job->max_rss)
+                {
+                    job->max_rss = usage->ru_maxrss;
+                }
+                if (job->running == 0 && is_later(when, &job->end))
+                {
+                    job->end = *when;
+                }
+                return;
             }
-            execute_command(command_line_words, num_args);
         }
-        // free the memory for this command
-        free_command(command_line_words);
+    }
+}
 
-        // get the next command
-        command_line_words = get_next_command(&num_args);
+/* match the children reaped so far to their jobs
+ * SIGCHLD must be blocked when this is called
+ */
+void collect_children(void)
+{
+    for (int i = 0; i < num_reaped; ++i)
+    {
+        mark_exited(reaped_pids[i], reaped_status[i], &reaped_usage[i], &reaped_time[i]);
     }
+    num_reaped = 0;
 
-    return 0;
+    // the handler stops when its buffer is full, so pick up anything it left behind
+    pid_t pid;
+    int status;
+    struct rusage usage;
+    struct timespec now;
+    while ((pid = wait4(-1, &status, WNOHANG, &usage)) > 0)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        mark_exited(pid, status, &usage, &now);
+    }
+}
+
+/* block SIGCHLD, saving the previous signal mask in old_mask unless it is NULL */
+static void block_sigchld(sigset_t *old_mask)
+{
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, old_mask);
+}
+
+/* join the words of a command line with spaces
+ * return the new string, or NULL if out of memory
+ */
+static char *join_words(char **command_line_words, size_t num_args)
+{
+    size_t length = 1;
+    for (size_t i = 0; i < num_args; ++i)
+    {
+        length += strlen(command_line_words[i]) + 1;
+    }
+    char *command = (char *)malloc(length);
+    if (command == NULL)
+    {
+        return NULL;
+    }
+    size_t offset = 0;
+    for (size_t i = 0; i < num_args; ++i)
+    {
+        if (i > 0)
+        {
+            command[offset++] = ' ';
+        }
+        size_t word_length = strlen(command_line_words[i]);
+        memcpy(command + offset, command_line_words[i], word_length);
+        offset += word_length;
+    }
+    command[offset] = '\0';
+    return command;
+}
+
+/* add a job for the started pipeline stages in pids, taking ownership of pids
+ * start is when the shell began starting the first stage
+ * the command line is only copied if keep_command is set, since a foreground
+ * job that no builtin can see and that isn't traced never shows it
+ */
+struct job *add_job(char **command_line_words, size_t num_args, size_t num_stages, pid_t *pids,
+                    size_t num_pids, int background, int keep_command, struct timespec *start)
+{
+    struct job *job = (struct job *)malloc(sizeof(struct job));
+    char *command = NULL;
+    if (job != NULL && keep_command)
+    {
+        command = join_words(command_line_words, num_args);
+        if (command == NULL)
+        {
+            free(job);
+            job = NULL;
+        }
+    }
+    if (job == NULL)
+    {
+        return NULL;
+    }
+
+    int id = 1;
+    struct job **link = &jobs;
+    for (; *link != NULL; link = &(*link)->next)
+    {
+        if ((*link)->id >= id)
+        {
+            id = (*link)->id + 1;
+        }
+    }
+    job->id = id;
+    job->command = command;
+    job->pids = pids;
+    job->num_pids = num_pids;
+    job->num_stages = num_stages;
+    job->running = num_pids;
+    job->status = 0;
+    job->last_started = 1;
+    job->background = background;
+    job->start = *start;
+    job->end = *start;
+    job->user.tv_sec = job->user.tv_usec = 0;
+    job->sys.tv_sec = job->sys.tv_usec = 0;
+    job->max_rss = 0;
+    job->next = NULL;
+    *link = job;
+    return job;
+}
+
+/* count a builtin that ran inside the shell as the last stage of job
+ * before and after are the shell's own resource usage around it, and end is when it returned
+ */
+void add_builtin_stage(struct job *job, int status, struct rusage *before, struct rusage *after,
+                       struct timespec *end)
+{
+    struct timeval t;
+    timersub(&after->ru_utime, &before->ru_utime, &t);
+    add_timeval(&job->user, &t);
+    timersub(&after->ru_stime, &before->ru_stime, &t);
+    add_timeval(&job->sys, &t);
+    if (after->ru_maxrss > job->max_rss)
+    {
+        job->max_rss = after->ru_maxrss;
+    }
+    job->last_started = 0;
+    job->status = status << 8;
+    if (is_later(end, &job->end))
+    {
+        job->end = *end;
+    }
+}
+
+/* write a JSON line with the resource usage of the finished job to the trace file */
+void trace_job(struct job *job)
+{
+    fputs("{\"command\":\"", trace_file);
+    for (char *c = job->command; *c != '\0'; ++c)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            fprintf(trace_file, "\\%c", *c);
+        }
+        else if ((unsigned char)*c < 0x20)
+        {
+            fprintf(trace_file, "\\u%04x", (unsigned char)*c);
+        }
+        else
+        {
+            fputc(*c, trace_file);
+        }
+    }
+    double wall = (job->end.tv_sec - job->start.tv_sec) + (job->end.tv_nsec - job->start.tv_nsec) / 1e9;
+    double user = job->user.tv_sec + job->user.tv_usec / 1e6;
+    double sys = job->sys.tv_sec + job->sys.tv_usec / 1e6;
+    fprintf(trace_file, "\",\"background\":%s,\"stages\":%zu,\"wall\":%.6f,\"user\":%.6f,"
+            "\"sys\":%.6f,\"max_rss_kb\":%ld,",
+            job->background ? "true" : "false", job->num_stages, wall, user, sys, job->max_rss);
+    if (WIFSIGNALED(job->status))
+    {
+        fprintf(trace_file, "\"signal\":%d}\n", WTERMSIG(job->status));
+    }
+    else
+    {
+        fprintf(trace_file, "\"exit\":%d}\n", WEXITSTATUS(job->status));
+    }
+    fflush(trace_file);
+}
+
+void remove_job(struct job *job)
+{
+    if (trace_file != NULL && job->running == 0)
+    {
+        trace_job(job);
+    }
+    for (struct job **link = &jobs; *link != NULL; link = &(*link)->next)
+    {
+        if (*link == job)
+        {
+            *link = job->next;
+            break;
+        }
+    }
+    free(job->command);
+    free(job->pids);
+    free(job);
+}
+
+/* wait until every stage of job has exited
+ * SIGCHLD must be blocked when this is called; old_mask is the mask to wait with
+ */
+void wait_for_job(struct job *job, sigset_t *old_mask)
+{
+    collect_children();
+    while (job->running > 0)
+    {
+        sigsuspend(old_mask);
+        collect_children();
+    }
+}
+
+/* print and remove the background jobs that have finished */
+void report_finished_jobs(void)
+{
+    sigset_t old_mask;
+    block_sigchld(&old_mask);
+    collect_children();
+    struct job *job = jobs;
+    while (job != NULL)
+    {
+        struct job *next = job->next;
+        if (job->running == 0)
+        {
+            if (interactive)
+            {
+                printf("[%d] Done\t%s\n", job->id, job->command);
+            }
+            remove_job(job);
+        }
+        job = next;
+    }
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+}
+
+/* find the job with the given id, or NULL if there isn't one */
+struct job *find_job_by_id(int id)
+{
+    for (struct job *job = jobs; job != NULL; job = job->next)
+    {
+        if (job->id == id)
+        {
+            return job;
+        }
+    }
+    return NULL;
+}
+
+/* find the job named by spec ("%n" or "n"), or the most recent job if spec is NULL */
+struct job *find_job(char *spec)
+{
+    if (spec == NULL)
+    {
+        struct job *last = jobs;
+        while (last != NULL && last->next != NULL)
+        {
+            last = last->next;
+        }
+        return last;
+    }
+    if (spec[0] == '%')
+    {
+        spec++;
+    }
+    char *end;
+    long id = strtol(spec, &end, 10);
+    if (*spec == '\0' || *end != '\0')
+    {
+        return NULL;
+    }
+    return find_job_by_id((int)id);
+}
+
+/* turn a wait status into an exit status the way sh does */
+int exit_code(int status)
+{
+    if (WIFSIGNALED(status))
+    {
+        return 128 + WTERMSIG(status);
+    }
+    return WEXITSTATUS(status);
+}
+
+int builtin_exit(size_t argc, char **argv, int in, int out)
+{
+    (void)in;
+    (void)out;
+    exit_requested = 1;
+    return argc > 1 ? atoi(argv[1]) & 0xff : last_status;
+}
+
+int builtin_cd(size_t argc, char **argv, int in, int out)
+{
+    (void)in;
+    if (argc > 2)
+    {
+        fprintf(stderr, "usage: cd [dir]\n");
+        return 1;
+    }
+    char *dir = argc == 2 ? argv[1] : getenv("HOME");
+    if (dir == NULL)
+    {
+        fprintf(stderr, "cd: HOME not set\n");
+        return 1;
+    }
+    if (strcmp(dir, "-") == 0)
+    {
+        dir = getenv("OLDPWD");
+        if (dir == NULL)
+        {
+            fprintf(stderr, "cd: OLDPWD not set\n");
+            return 1;
+        }
+        dprintf(out, "%s\n", dir);
+    }
+    char *old = getcwd(NULL, 0);
+    if (chdir(dir) == -1)
+    {
+        fprintf(stderr, "cd: %s: %s\n", dir, strerror(errno));
+        free(old);
+        return 1;
+    }
+    if (old != NULL)
+    {
+        setenv("OLDPWD", old, 1);
+        free(old);
+    }
+    char *now = getcwd(NULL, 0);
+    if (now != NULL)
+    {
+        setenv("PWD", now, 1);
+        free(now);
+    }
+    // commands found through a relative PATH entry may now be somewhere else
+    forget_relative_paths();
+    return 0;
+}
+
+int builtin_pwd(size_t argc, char **argv, int in, int out)
+{
+    (void)argc;
+    (void)argv;
+    (void)in;
+    char *dir = getcwd(NULL, 0);
+    if (dir == NULL)
+    {
+        perror("pwd");
+        return 1;
+    }
+    dprintf(out, "%s\n", dir);
+    free(dir);
+    return 0;
+}
+
+int builtin_export(size_t argc, char **argv, int in, int out)
+{
+    (void)in;
+    if (argc == 1)
+    {
+        for (char **env = environ; *env != NULL; ++env)
+        {
+            dprintf(out, "export %s\n", *env);
+        }
+        return 0;
+    }
+    int result = 0;
+    for (size_t i = 1; i < argc; ++i)
+    {
+        // every variable is already exported, so only NAME=value does anything
+        char *equals = strchr(argv[i], '=');
+        if (equals == NULL)
+        {
+            continue;
+        }
+        if (equals == argv[i])
+        {
+            fprintf(stderr, "export: %s: bad variable name\n", argv[i]);
+            result = 1;
+            continue;
+        }
+        // the word lives in the shell's line buffer, so split it in place
+        *equals = '\0';
+        if (setenv(argv[i], equals + 1, 1) == -1)
+        {
+            fprintf(stderr, "export: %s: %s\n", argv[i], strerror(errno));
+            result = 1;
+        }
+        else if (strcmp(argv[i], "PATH") == 0)
+        {
+            clear_path_cache();
+        }
+        *equals = '=';
+    }
+    return result;
+}
+
+int builtin_hash(size_t argc, char **argv, int in, int out)
+{
+    (void)in;
+    if (argc == 2 && strcmp(argv[1], "-r") == 0)
+    {
+        clear_path_cache();
+    }
+    else if (argc == 1)
+    {
+        print_path_cache(out);
+    }
+    else
+    {
+        fprintf(stderr, "usage: hash [-r]\n");
+        return 1;
+    }
+    return 0;
+}
+
+/* the jobs builtin: list every background job */
+int builtin_jobs(size_t argc, char **argv, int in, int out)
+{
+    (void)argc;
+    (void)argv;
+    (void)in;
+    sigset_t old_mask;
+    block_sigchld(&old_mask);
+    collect_children();
+    for (struct job *job = jobs; job != NULL; job = job->next)
+    {
+        dprintf(out, "[%d] %s\t%s\n", job->id, job->running > 0 ? "Running" : "Done", job->command);
+    }
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+    return 0;
+}
+
+/* wait for one job (or, for wait with no spec, all of them) and return its exit status */
+int wait_builtin(size_t argc, char **argv, int foreground, int out)
+{
+    if (argc > 2)
+    {
+        fprintf(stderr, "usage: %s [%%job]\n", argv[0]);
+        return 2;
+    }
+    int result = 0;
+    sigset_t old_mask;
+    block_sigchld(&old_mask);
+    if (argc == 1 && !foreground)
+    {
+        while (jobs != NULL)
+        {
+            wait_for_job(jobs, &old_mask);
+            remove_job(jobs);
+        }
+    }
+    else
+    {
+        struct job *job = find_job(argc == 2 ? argv[1] : NULL);
+        if (job == NULL)
+        {
+            fprintf(stderr, "%s: no such job\n", argv[0]);
+            result = 127;
+        }
+        else
+        {
+            if (foreground)
+            {
+                dprintf(out, "%s\n", job->command);
+            }
+            wait_for_job(job, &old_mask);
+            result = exit_code(job->status);
+            remove_job(job);
+        }
+    }
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+    return result;
+}
+
+int builtin_wait(size_t argc, char **argv, int in, int out)
+{
+    (void)in;
+    return wait_builtin(argc, argv, 0, out);
+}
+
+int builtin_fg(size_t argc, char **argv, int in, int out)
+{
+    (void)in;
+    return wait_builtin(argc, argv, 1, out);
+}
+
+/* run a command shared with one of the standalone programs, giving it a stdio stream over out */
+static int run_shared_command(int (*command)(int, char **, int, FILE *), size_t argc, char **argv,
+                              int in, int out)
+{
+    int fd = dup(out);
+    FILE *stream = fd == -1 ? NULL : fdopen(fd, "w");
+    if (stream == NULL)
+    {
+        perror(argv[0]);
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        return 1;
+    }
+    int status = command((int)argc, argv, in, stream);
+    fclose(stream);
+    return status;
+}
+
+/* counts/wc.c's wc, without starting a process */
+int builtin_wc(size_t argc, char **argv, int in, int out)
+{
+    return run_shared_command(wc_command, argc, argv, in, out);
+}
+
+/* stats/stats.c's stats, without starting a process */
+int builtin_stats(size_t argc, char **argv, int in, int out)
+{
+    return run_shared_command(stats_command, argc, argv, in, out);
+}
+
+static struct builtin builtins[] =
+{
+    {"exit", builtin_exit, 0},
+    {"cd", builtin_cd, 0},
+    {"pwd", builtin_pwd, 0},
+    {"export", builtin_export, 0},
+    {"hash", builtin_hash, 0},
+    {"jobs", builtin_jobs, 0},
+    {"wait", builtin_wait, 0},
+    {"fg", builtin_fg, 0},
+    {"wc", builtin_wc, 1},
+    {"stats", builtin_stats, 1},
+};
+
+/* return the builtin that runs argv, or NULL if it's an ordinary program */
+struct builtin *find_builtin(char **argv)
+{
+    for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); ++i)
+    {
+        struct builtin *builtin = &builtins[i];
+        if (strcmp(argv[0], builtin->name) == 0)
+        {
+            if (builtin->optional && !use_optional_builtins)
+            {
+                return NULL;
+            }
+            return builtin;
+        }
+    }
+    return NULL;
+}
+
+/* run a builtin with in and out as its stdin and stdout, after applying redirect */
+int run_builtin(struct builtin *builtin, char **argv, struct redirection *redirect, int in, int out)
+{
+    int input_fd, output_fd;
+    if (open_redirection(redirect, &input_fd, &output_fd) != 0)
+    {
+        return 1;
+    }
+    if (input_fd != -1)
+    {
+        in = input_fd;
+    }
+    if (output_fd != -1)
+    {
+        out = output_fd;
+    }
+    size_t argc = 0;
+    while (argv[argc] != NULL)
+    {
+        argc++;
+    }
+    int status = builtin->run(argc, argv, in, out);
+    if (input_fd != -1)
+    {
+        close(input_fd);
+    }
+    if (output_fd != -1)
+    {
+        close(output_fd);
+    }
+    return status;
+}
+
+void execute_command(char **command_line_words, int *kinds, size_t num_args, int background)
+{
+    // split the words into pipeline stages at each "|"
+    size_t num_stages = 1;
+    for (size_t i = 0; i < num_args; ++i)
+    {
+        if (kinds[i] == TOKEN_PIPE)
+        {
+            num_stages++;
+        }
+    }
+    size_t *stage_start = (size_t *)malloc(num_stages * sizeof(size_t));
+    size_t *stage_length = (size_t *)malloc(num_stages * sizeof(size_t));
+    pid_t *pids = (pid_t *)malloc(num_stages * sizeof(pid_t));
+    char **argv = (char **)malloc((num_args + 1) * sizeof(char *));
+    if (stage_start == NULL || stage_length == NULL || pids == NULL || argv == NULL)
+    {
+        fprintf(stderr, "Memory error!\n");
+        free(stage_start);
+        free(stage_length);
+        free(pids);
+        free(argv);
+        last_status = 1;
+        return;
+    }
+    size_t stage = 0;
+    stage_start[0] = 0;
+    for (size_t i = 0; i <= num_args; ++i)
+    {
+        if (i == num_args || kinds[i] == TOKEN_PIPE)
+        {
+            stage_length[stage] = i - stage_start[stage];
+            if (stage_length[stage] == 0)
+            {
+                fprintf(stderr, "Error! Missing command in pipeline!\n");
+                free(stage_start);
+                free(stage_length);
+                free(pids);
+                free(argv);
+                last_status = 1;
+                return;
+            }
+            if (i < num_args)
+            {
+                stage_start[++stage] = i + 1;
+            }
+        }
+    }
+
+    // anything the shell printed has to come out before the command's output
+    fflush(stdout);
+
+    // children shouldn't inherit the blocked SIGCHLD below
+    posix_spawnattr_t attr;
+    sigset_t empty_mask;
+    sigemptyset(&empty_mask);
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setsigmask(&attr, &empty_mask);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+
+    // keep the SIGCHLD handler from reaping a stage before its job exists
+    sigset_t old_mask;
+    block_sigchld(&old_mask);
+
+    // the wall time covers starting the stages, not just waiting for them
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // start every stage, connecting each one's stdout to the next one's stdin
+    size_t started = 0;
+    int prev_read = -1;
+    struct builtin *last_builtin = NULL;
+    struct redirection redirect;
+    int failed_status = -1; // the status to report if the command or its last stage couldn't start
+    for (stage = 0; stage < num_stages; ++stage)
+    {
+        if (handle_redirection(command_line_words + stage_start[stage], kinds + stage_start[stage],
+                               stage_length[stage], argv, &redirect) != 0)
+        {
+            failed_status = 1;
+            break;
+        }
+        struct builtin *builtin = find_builtin(argv);
+        if (builtin != NULL && stage + 1 == num_stages && !background)
+        {
+            // the last stage of a foreground command runs in the shell itself, below
+            last_builtin = builtin;
+            break;
+        }
+
+        int fds[2] = {-1, -1};
+        if (stage + 1 < num_stages && pipe(fds) == -1)
+        {
+            perror("pipe");
+            failed_status = 1;
+            break;
+        }
+
+        pid_t pid = -1;
+        int stage_failure = 1;
+        int input_fd, output_fd;
+        if (builtin != NULL)
+        {
+            // any other builtin stage needs its own process to run alongside the rest
+            pid = fork();
+            if (pid == 0)
+            {
+                int in = prev_read;
+                if (fds[0] != -1)
+                {
+                    close(fds[0]);
+                }
+                if (in == -1 && background)
+                {
+                    in = open("/dev/null", O_RDONLY);
+                }
+                _exit(run_builtin(builtin, argv, &redirect, in == -1 ? STDIN_FILENO : in,
+                                  fds[1] == -1 ? STDOUT_FILENO : fds[1]));
+            }
+            else if (pid == -1)
+            {
+                perror("fork");
+            }
+        }
+        else if (open_redirection(&redirect, &input_fd, &output_fd) == 0)
+        {
+            // the pipe comes first so that an explicit redirection overrides it
+            posix_spawn_file_actions_t actions;
+            posix_spawn_file_actions_init(&actions);
+            if (prev_read != -1)
+            {
+                posix_spawn_file_actions_adddup2(&actions, prev_read, STDIN_FILENO);
+                posix_spawn_file_actions_addclose(&actions, prev_read);
+            }
+            else if (background)
+            {
+                // background jobs don't get to read from the terminal
+                posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+            }
+            if (fds[1] != -1)
+            {
+                posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+                posix_spawn_file_actions_addclose(&actions, fds[0]);
+                posix_spawn_file_actions_addclose(&actions, fds[1]);
+            }
+            if (input_fd != -1)
+            {
+                posix_spawn_file_actions_adddup2(&actions, input_fd, STDIN_FILENO);
+            }
+            if (output_fd != -1)
+            {
+                posix_spawn_file_actions_adddup2(&actions, output_fd, STDOUT_FILENO);
+            }
+            pid = spawn_command(argv, &actions, &attr, &stage_failure);
+            posix_spawn_file_actions_destroy(&actions);
+            if (input_fd != -1)
+            {
+                close(input_fd);
+            }
+            if (output_fd != -1)
+            {
+                close(output_fd);
+            }
+        }
+        if (pid != -1)
+        {
+            pids[started++] = pid;
+        }
+        else if (stage + 1 == num_stages)
+        {
+            failed_status = stage_failure;
+        }
+        // a stage that didn't start leaves the next one reading an empty pipe
+        if (prev_read != -1)
+        {
+            close(prev_read);
+        }
+        if (fds[1] != -1)
+        {
+            close(fds[1]);
+        }
+        prev_read = fds[0];
+    }
+    posix_spawnattr_destroy(&attr);
+
+    struct job *job = NULL;
+    if (started > 0)
+    {
+        // jobs and fg can only show a foreground job from a builtin at the end of its pipeline
+        int keep_command = background || trace_file != NULL || last_builtin != NULL;
+        job = add_job(command_line_words, num_args, num_stages, pids, started, background,
+                      keep_command, &start);
+    }
+    if (job != NULL && failed_status != -1)
+    {
+        // the stages that did start still run, but the command's status is the failure
+        job->last_started = 0;
+        job->status = failed_status << 8; // the wait status of a process that exited with it
+    }
+    if (job == NULL)
+    {
+        // nothing started, or no memory to track it; wait for whatever did start
+        for (size_t i = 0; i < started; ++i)
+        {
+            int status;
+            while (waitpid(pids[i], &status, 0) == -1 && errno == EINTR)
+            {
+            }
+        }
+        free(pids);
+    }
+    int job_id = job == NULL ? 0 : job->id;
+
+    int builtin_status = 0;
+    struct rusage before, after;
+    struct timespec builtin_end;
+    if (last_builtin != NULL)
+    {
+        // builtins like wait and fg need SIGCHLD, and the job already exists to catch it
+        sigprocmask(SIG_SETMASK, &old_mask, NULL);
+        if (trace_file != NULL)
+        {
+            getrusage(RUSAGE_SELF, &before);
+        }
+        builtin_status = run_builtin(last_builtin, argv, &redirect,
+                                     prev_read == -1 ? STDIN_FILENO : prev_read, STDOUT_FILENO);
+        if (trace_file != NULL)
+        {
+            getrusage(RUSAGE_SELF, &after);
+            clock_gettime(CLOCK_MONOTONIC, &builtin_end);
+        }
+        block_sigchld(NULL);
+    }
+    if (prev_read != -1)
+    {
+        close(prev_read);
+    }
+    free(stage_start);
+    free(stage_length);
+    free(argv);
+
+    // a wait builtin in the pipeline may already have removed the job
+    job = find_job_by_id(job_id);
+    if (last_builtin != NULL && trace_file != NULL)
+    {
+        // the builtin is traced as the last stage, in a job of its own if nothing else started
+        if (job == NULL)
+        {
+            job = add_job(command_line_words, num_args, num_stages, NULL, 0, 0, 1, &start);
+        }
+        if (job != NULL)
+        {
+            add_builtin_stage(job, builtin_status, &before, &after, &builtin_end);
+        }
+    }
+    if (job != NULL && background)
+    {
+        // scripts and -c get background jobs too; only the job message is for the terminal
+        if (interactive)
+        {
+            printf("[%d] %d\n", job->id, (int)job->pids[job->num_pids - 1]);
+        }
+    }
+    else if (job != NULL)
+    {
+        wait_for_job(job, &old_mask);
+        last_status = exit_code(job->status);
+        remove_job(job);
+    }
+    if (last_builtin != NULL)
+    {
+        last_status = builtin_status;
+    }
+    else if (started == 0 && failed_status != -1 && !background)
+    {
+        last_status = failed_status;
+    }
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+}
+
+void usage(void)
+{
+    fprintf(stderr, "usage: cssh [-b] [-t tracefile] [-c command | script]\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    struct command cmd = {NULL, 0, NULL, NULL, 0, 0};
+    FILE *input = stdin;
+    int opt;
+    while ((opt = getopt(argc, argv, "bc:t:")) != -1)
+    {
+        if (opt == 'b')
+        {
+            use_optional_builtins = 1;
+        }
+        else if (opt == 'c')
+        {
+            input = fmemopen(optarg, strlen(optarg), "r");
+            if (input == NULL)
+            {
+                perror("fmemopen");
+                exit(1);
+            }
+            interactive = 0;
+        }
+        else if (opt == 't')
+        {
+            trace_file = strcmp(optarg, "-") == 0 ? stderr : fopen(optarg, "we");
+            if (trace_file == NULL)
+            {
+                perror(optarg);
+                exit(1);
+            }
+        }
+        else
+        {
+            usage();
+        }
+    }
+    if (optind < argc)
+    {
+        if (input != stdin || optind + 1 < argc)
+        {
+            usage();
+        }
+        input = fopen(argv[optind], "re");
+        if (input == NULL)
+        {
+            perror(argv[optind]);
+            exit(1);
+        }
+        interactive = 0;
+    }
+
+    struct sigaction sa;
+    sa.sa_handler = handle_sigchld;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &sa, NULL);
+
+    // get the next command
+    while (get_next_command(input, interactive, &cmd))
+    {
+        char **command_line_words = cmd.words;
+        size_t num_args = cmd.num_words;
+        if (num_args > 0)
+        {
+            // a trailing & runs the command in the background
+            int background = cmd.kinds[num_args - 1] == TOKEN_BACKGROUND;
+            if (background)
+            {
+                num_args--;
+            }
+            for (size_t i = 0; i < num_args; ++i)
+            {
+                if (cmd.kinds[i] == TOKEN_BACKGROUND)
+                {
+                    fprintf(stderr, "Error! & can only end a command!\n");
+                    num_args = 0;
+                    last_status = 1;
+                }
+            }
+            if (num_args > 0)
+            {
+                execute_command(command_line_words, cmd.kinds, num_args, background);
+            }
+        }
+        report_finished_jobs();
+        if (exit_requested)
+        {
+            break;
+        }
+    }
+    // free the buffers for the commands
+    free_command(&cmd);
+    clear_path_cache();
+    while (jobs != NULL)
+    {
+        remove_job(jobs);
+    }
+    if (input != stdin)
+    {
+        fclose(input);
+    }
+    if (trace_file != NULL && trace_file != stderr)
+    {
+        fclose(trace_file);
+    }
+
+    return last_status;
 }
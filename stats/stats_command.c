@@ -0,0 +1,642 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <time.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "stats_command.h"
+
+/* number of values decoded at a time before being folded into the running stats */
+#define BLOCK_SIZE 4096
+
+/* size of each mmap() window over a binary file (a multiple of any page size) */
+#define MAP_WINDOW (64 * 1024 * 1024)
+
+/* size of the read() buffer used for text files */
+#define READ_SIZE (1024 * 1024)
+
+/* --target-ci doesn't trust the spread of fewer sample means than this */
+#define MIN_CI_SAMPLES 10
+
+/* running statistics that can be built up one block of values at a time */
+struct running_stats
+{
+    long long count;
+    double min;
+    double max;
+    double mean;
+    double m2; // sum of squared differences from the mean
+};
+
+/* incremental state for parsing one number out of a text stream */
+struct number_parser
+{
+    int active;           // a field has started
+    int invalid;          // the field contains something that isn't part of a number
+    int negative;
+    int has_digits;
+    unsigned long long mantissa;
+    int mantissa_digits;  // significant digits held in mantissa
+    int scale;            // power of ten to apply to mantissa
+    int in_fraction;
+    int in_exponent;
+    int exponent_sign;    // 0 until a sign follows the 'e'
+    int exponent_digits;  // digits seen after the 'e'
+    int exponent;
+};
+
+/* print the usage message to out and return the exit status for a usage error */
+static int usage(FILE *out);
+static int is_valid_int(char *s);
+static int *generate_population(int size, int lower, int upper);
+static void get_stats(int *a, int size, int *min, int *max, double *mean, double *stddev);
+
+/* reset s to hold no values */
+static void running_stats_init(struct running_stats *s);
+
+/* fold n values from block into s */
+static void running_stats_add(struct running_stats *s, double *block, int n);
+
+/* print the statistics for the values in file name, read as format, to out
+ * format is one of text, int32, int64, or double, and "-" reads text from in
+ * return 0 on success and 1 on error
+ */
+static int file_stats(char *format, char *name, int in, FILE *out);
+
+/* compute statistics over a raw little-endian array of elem_size byte values */
+static int binary_file_stats(char *name, char *format, size_t elem_size, struct running_stats *s);
+
+/* compute statistics over the numbers in a text file ("-" for in) */
+static int text_file_stats(char *name, int in, struct running_stats *s, long long *skipped);
+
+/* half-width of the 95% confidence interval for the mean of the values in s */
+static double ci_half_width(struct running_stats *s);
+
+int stats_command(int argc, char **argv, int in, FILE *out)
+{
+    if (argc > 1 && strcmp(argv[1], "-f") == 0)
+    {
+        if (argc != 4)
+        {
+            fprintf(out, "incorrect number of arguments\n");
+            return usage(out);
+        }
+        return file_stats(argv[2], argv[3], in, out);
+    }
+    double target_ci = 0.0; // 0 means always run every sample
+    if (argc > 1 && strcmp(argv[1], "--target-ci") == 0)
+    {
+        char *end;
+        if (argc > 2)
+        {
+            target_ci = strtod(argv[2], &end);
+        }
+        if (argc <= 2 || argv[2][0] == '\0' || *end != '\0' || !(target_ci > 0.0))
+        {
+            fprintf(out, "target-ci must be a positive number\n");
+            return usage(out);
+        }
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc != 5)
+    {
+        fprintf(out, "incorrect number of arguments\n");
+        return usage(out);
+    }
+    for (int i = 1; i < argc; i++)
+    {
+        if (is_valid_int(argv[i]) == 0)
+        {
+            fprintf(out, "all arguments must be integers\n");
+            return usage(out);
+        }
+    }
+    if (atoi(argv[1]) < 1)
+    {
+        fprintf(out, "samples must be a positive integer\n");
+        return usage(out);
+    }
+    if (atoi(argv[2]) < 1)
+    {
+        fprintf(out, "population must be a positive integer\n");
+        return usage(out);
+    }
+    if (atoi(argv[4]) < atoi(argv[3]))
+    {
+        fprintf(out, "upperbound must be >= lowerbound\n");
+        return usage(out);
+    }
+    srand(time(NULL));
+    int num_samples = atoi(argv[1]);
+    int population_size = atoi(argv[2]);
+    int lower_bound = atoi(argv[3]);
+    int upper_bound = atoi(argv[4]);
+    struct running_stats means; // the mean of each sample so far
+    running_stats_init(&means);
+    int converged = 0;
+    for (int i = 1; i <= num_samples && !converged; i++)
+    {
+        int minimum;
+        int *min = &minimum;
+        int maximum;
+        int *max = &maximum;
+        double mean_value;
+        double *mean = &mean_value;
+        double standard_deviation;
+        double *stddev = &standard_deviation;
+        int *p = generate_population(population_size, lower_bound, upper_bound);
+        if (p == NULL)
+        {
+            return 1;
+        }
+        get_stats(p, population_size, min, max, mean, stddev);
+        free(p);
+        fprintf(out, "Sample %i: min=%i, max=%i, mean=%g, stddev=%g\n", i, *min, *max, *mean, *stddev);
+        running_stats_add(&means, mean, 1);
+        if (target_ci > 0.0 && means.count >= MIN_CI_SAMPLES && ci_half_width(&means) <= target_ci)
+        {
+            converged = 1;
+        }
+    } 
+    if (target_ci > 0.0)
+    {
+        fprintf(out, "%s after %lld samples (%lld draws): mean=%g, 95%% CI=+/-%g\n",
+               converged ? "Converged" : "Did not converge", means.count,
+               means.count * population_size, means.mean, ci_half_width(&means));
+    }
+    return 0;
+}
+
+static int usage(FILE *out)
+{
+    fprintf(out, "\nusage: stats samples population lowerbound upperbound\n");
+    fprintf(out, "       stats --target-ci width samples population lowerbound upperbound\n");
+    fprintf(out, "       stats -f format file\n");
+    fprintf(out, "       width: stop once the 95%% confidence interval of the mean is within +/-width\n");
+    fprintf(out, "       samples: number of samples (the most to run with --target-ci)\n");
+    fprintf(out, "       population: number of random values to generate in each sample\n");
+    fprintf(out, "       lowerbound: bottom of random number range\n");
+    fprintf(out, "       upperbound: top of random number range\n");
+    fprintf(out, "       format: text, int32, int64, or double\n");
+    fprintf(out, "       file: file of values to summarize (\"-\" for stdin with text)\n");
+    return 1;
+}
+
+static int is_valid_int(char *s)
+{
+    if (s == NULL)
+    {
+        return -1;    
+    }
+
+    if (*s == '-')
+    {
+        ++s;
+    }
+    while (*s != '\0')
+    {
+        if (!isdigit(*s))
+        {
+            return 0;
+        }
+        ++s;
+    }
+    return 1;
+}
+
+static int *generate_population(int size, int lower, int upper)
+{
+    int *array = (int *)calloc(size, sizeof(int));
+    if (array == NULL)
+    {
+        return NULL;
+    }
+    for (int i = 0; i < size; i++)
+    {
+        array[i] = (rand() % (upper-lower+1)) + lower;
+    }
+    return array;
+}
+
+static void get_stats(int *a, int size, int *min, int *max, double *mean, double *stddev)
+{
+    if (a == NULL || min == NULL || max == NULL || mean == NULL || stddev == NULL)
+    {
+        return;
+    }
+    *min = a[0];
+    *max = a[0];
+    double sum = 0.0;
+    for (int i = 0; i < size; i++)
+    {
+        if (a[i] < *min)
+        {
+            *min = a[i];
+        }
+        if (a[i] > *max)
+        {
+            *max = a[i];
+        }
+        sum += a[i];
+    }
+    *mean = sum/size;
+    sum = 0.0;
+    for (int i = 0; i < size; i++)
+    {
+        sum += (a[i] - *mean) * (a[i] - *mean);
+    }
+    *stddev = sqrt(sum/size);
+}
+
+static void running_stats_init(struct running_stats *s)
+{
+    s->count = 0;
+    s->min = 0.0;
+    s->max = 0.0;
+    s->mean = 0.0;
+    s->m2 = 0.0;
+}
+
+static void running_stats_add(struct running_stats *s, double *block, int n)
+{
+    if (s == NULL || block == NULL || n <= 0)
+    {
+        return;
+    }
+    // two passes over the block, then merge it into the running totals
+    double block_min = block[0];
+    double block_max = block[0];
+    double sum = 0.0;
+    for (int i = 0; i < n; i++)
+    {
+        if (block[i] < block_min)
+        {
+            block_min = block[i];
+        }
+        if (block[i] > block_max)
+        {
+            block_max = block[i];
+        }
+        sum += block[i];
+    }
+    double block_mean = sum/n;
+    double block_m2 = 0.0;
+    for (int i = 0; i < n; i++)
+    {
+        block_m2 += (block[i] - block_mean) * (block[i] - block_mean);
+    }
+    if (s->count == 0)
+    {
+        s->count = n;
+        s->min = block_min;
+        s->max = block_max;
+        s->mean = block_mean;
+        s->m2 = block_m2;
+        return;
+    }
+    if (block_min < s->min)
+    {
+        s->min = block_min;
+    }
+    if (block_max > s->max)
+    {
+        s->max = block_max;
+    }
+    double total = (double)s->count + n;
+    double delta = block_mean - s->mean;
+    s->mean += delta * n / total;
+    s->m2 += block_m2 + delta * delta * ((double)s->count * n / total);
+    s->count += n;
+}
+
+static int file_stats(char *format, char *name, int in, FILE *out)
+{
+    struct running_stats s;
+    long long skipped = 0;
+    int result;
+    running_stats_init(&s);
+    if (strcmp(format, "text") == 0)
+    {
+        result = text_file_stats(name, in, &s, &skipped);
+    }
+    else if (strcmp(format, "int32") == 0)
+    {
+        result = binary_file_stats(name, format, 4, &s);
+    }
+    else if (strcmp(format, "int64") == 0 || strcmp(format, "double") == 0)
+    {
+        result = binary_file_stats(name, format, 8, &s);
+    }
+    else
+    {
+        fprintf(out, "format must be text, int32, int64, or double\n");
+        return usage(out);
+    }
+    if (result != 0)
+    {
+        return 1;
+    }
+    if (skipped > 0)
+    {
+        fprintf(stderr, "%s: skipped %lld non-numeric fields\n", name, skipped);
+    }
+    if (s.count == 0)
+    {
+        fprintf(out, "%s: no values\n", name);
+        return 1;
+    }
+    fprintf(out, "%s: count=%lld, min=%.15g, max=%.15g, mean=%g, stddev=%g\n",
+           name, s.count, s.min, s.max, s.mean, sqrt(s.m2/s.count));
+    return 0;
+}
+
+/* decode one little-endian value of the given format starting at p */
+static double decode_value(unsigned char *p, char format)
+{
+    if (format == '3')
+    {
+        uint32_t u = (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+        return (double)(int32_t)u;
+    }
+    uint64_t u = 0;
+    for (int i = 7; i >= 0; i--)
+    {
+        u = (u << 8) | p[i];
+    }
+    if (format == '6')
+    {
+        return (double)(int64_t)u;
+    }
+    double d;
+    memcpy(&d, &u, sizeof(d));
+    return d;
+}
+
+static int binary_file_stats(char *name, char *format, size_t elem_size, struct running_stats *s)
+{
+    // int32 -> '3', int64 -> '6', double -> 'd'
+    char kind = format[0] == 'd' ? 'd' : format[3];
+    int fd = open(name, O_RDONLY);
+    if (fd == -1)
+    {
+        perror(name);
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+    {
+        perror(name);
+        close(fd);
+        return 1;
+    }
+    off_t size = st.st_size;
+    if (size % elem_size != 0)
+    {
+        fprintf(stderr, "%s: ignoring %lld trailing bytes\n", name, (long long)(size % elem_size));
+        size -= size % elem_size;
+    }
+    double block[BLOCK_SIZE];
+    // map the file one window at a time so memory use stays bounded
+    for (off_t offset = 0; offset < size; offset += MAP_WINDOW)
+    {
+        size_t length = size - offset < MAP_WINDOW ? (size_t)(size - offset) : MAP_WINDOW;
+        unsigned char *map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, offset);
+        if (map == MAP_FAILED)
+        {
+            perror(name);
+            close(fd);
+            return 1;
+        }
+        posix_madvise(map, length, POSIX_MADV_SEQUENTIAL);
+        size_t count = length / elem_size;
+        for (size_t i = 0; i < count; i += BLOCK_SIZE)
+        {
+            int n = count - i < BLOCK_SIZE ? (int)(count - i) : BLOCK_SIZE;
+            unsigned char *p = map + i * elem_size;
+            for (int j = 0; j < n; j++)
+            {
+                block[j] = decode_value(p + j * elem_size, kind);
+            }
+            running_stats_add(s, block, n);
+        }
+        munmap(map, length);
+    }
+    close(fd);
+    return 0;
+}
+
+/* exact powers of ten that fit in a double */
+static const double powers_of_ten[] =
+{
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static void parser_reset(struct number_parser *p)
+{
+    memset(p, 0, sizeof(*p));
+}
+
+/* finish the current field, storing its value in *value
+ * return 1 if the field was a number, 0 if it was skipped, -1 if there was no field
+ */
+static int parser_finish(struct number_parser *p, double *value)
+{
+    if (!p->active)
+    {
+        return -1;
+    }
+    int ok = !p->invalid && p->has_digits && !(p->in_exponent && p->exponent_digits == 0);
+    if (ok)
+    {
+        int e = p->scale + (p->exponent_sign < 0 ? -p->exponent : p->exponent);
+        double v = (double)p->mantissa;
+        if (v != 0.0 && e != 0)
+        {
+            if (e > 0)
+            {
+                v = e <= 22 ? v * powers_of_ten[e] : v * pow(10.0, e);
+            }
+            else
+            {
+                v = -e <= 22 ? v / powers_of_ten[-e] : v * pow(10.0, e);
+            }
+        }
+        *value = p->negative ? -v : v;
+    }
+    parser_reset(p);
+    return ok;
+}
+
+/* feed one non-separator character into the current field */
+static void parser_feed(struct number_parser *p, unsigned char c)
+{
+    int first = !p->active;
+    p->active = 1;
+    if (p->invalid)
+    {
+        return;
+    }
+    if (c >= '0' && c <= '9')
+    {
+        int d = c - '0';
+        if (p->in_exponent)
+        {
+            p->exponent_digits++;
+            if (p->exponent < 10000)
+            {
+                p->exponent = p->exponent * 10 + d;
+            }
+            return;
+        }
+        p->has_digits = 1;
+        if (p->mantissa_digits < 19)
+        {
+            if (p->mantissa != 0 || d != 0)
+            {
+                p->mantissa = p->mantissa * 10 + d;
+                p->mantissa_digits++;
+            }
+            if (p->in_fraction)
+            {
+                p->scale--;
+            }
+        }
+        else if (!p->in_fraction)
+        {
+            // digits beyond what the mantissa can hold only shift the magnitude
+            p->scale++;
+        }
+    }
+    else if ((c == '-' || c == '+') && first)
+    {
+        p->negative = c == '-';
+    }
+    else if ((c == '-' || c == '+') && p->in_exponent && p->exponent_sign == 0
+             && p->exponent_digits == 0)
+    {
+        p->exponent_sign = c == '-' ? -1 : 1;
+    }
+    else if (c == '.' && !p->in_fraction && !p->in_exponent)
+    {
+        p->in_fraction = 1;
+    }
+    else if ((c == 'e' || c == 'E') && p->has_digits && !p->in_exponent)
+    {
+        p->in_exponent = 1;
+    }
+    else
+    {
+        p->invalid = 1;
+    }
+}
+
+static int text_file_stats(char *name, int in, struct running_stats *s, long long *skipped)
+{
+    int fd = in;
+    if (strcmp(name, "-") != 0)
+    {
+        fd = open(name, O_RDONLY);
+        if (fd == -1)
+        {
+            perror(name);
+            return 1;
+        }
+    }
+    static unsigned char buffer[READ_SIZE];
+    double block[BLOCK_SIZE];
+    int n = 0;
+    struct number_parser p;
+    parser_reset(&p);
+    ssize_t successfully_read;
+    // fields are separated by whitespace, commas, or semicolons and may span reads
+    while ((successfully_read = read(fd, buffer, READ_SIZE)) > 0)
+    {
+        for (ssize_t i = 0; i < successfully_read; i++)
+        {
+            unsigned char c = buffer[i];
+            if (c == ' ' || c == '\n' || c == ',' || c == '\t' || c == '\r' || c == ';' || c == '\f' || c == '\v')
+            {
+                int found = parser_finish(&p, &block[n]);
+                if (found == 1 && ++n == BLOCK_SIZE)
+                {
+                    running_stats_add(s, block, n);
+                    n = 0;
+                }
+                else if (found == 0)
+                {
+                    (*skipped)++;
+                }
+            }
+            else
+            {
+                parser_feed(&p, c);
+            }
+        }
+    }
+    if (successfully_read == -1)
+    {
+        perror(name);
+        if (fd != in)
+        {
+            close(fd);
+        }
+        return 1;
+    }
+    int found = parser_finish(&p, &block[n]);
+    if (found == 1)
+    {
+        n++;
+    }
+    else if (found == 0)
+    {
+        (*skipped)++;
+    }
+    running_stats_add(s, block, n);
+    if (fd != in)
+    {
+        close(fd);
+    }
+    return 0;
+}
+
+/* two-sided 95% critical values of Student's t for 1 to 30 degrees of freedom */
+static const double t_critical[] =
+{
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+static double ci_half_width(struct running_stats *s)
+{
+    if (s->count < 2)
+    {
+        return INFINITY;
+    }
+    long long df = s->count - 1;
+    double t;
+    if (df <= 30)
+    {
+        t = t_critical[df - 1];
+    }
+    else
+    {
+        // Cornish-Fisher expansion of t around the normal z = 1.96, within 0.0005 past df = 30
+        double z = 1.959964;
+        double z3 = z * z * z;
+        double z5 = z3 * z * z;
+        t = z + (z3 + z) / (4.0 * df) + (5.0 * z5 + 16.0 * z3 + 3.0 * z) / (96.0 * df * df);
+    }
+    // standard error of the mean from the sample standard deviation
+    return t * sqrt(s->m2 / df) / sqrt((double)s->count);
+}
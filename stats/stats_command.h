@@ -0,0 +1,12 @@
+#ifndef STATS_COMMAND_H
+#define STATS_COMMAND_H
+
+#include <stdio.h>
+
+/* run the stats command with the given arguments, reading "-" from in and printing to out
+ * shared by the stats program and the cssh builtin, so errors are returned rather than exit()ed
+ * return the command's exit status
+ */
+int stats_command(int argc, char **argv, int in, FILE *out);
+
+#endif
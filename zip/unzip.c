@@ -0,0 +1,425 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* Use 16-bit code words */
+#define NUM_CODES 65536
+
+/* Index 256, which is the first index after the ASCII dictionary entries */
+#define AFTER_ASCII 256
+
+/* the magic number zip -h writes at the start of an entropy-coded file */
+#define HUFFMAN_MAGIC "LZWH"
+
+/* number of codes Huffman coded together with one pair of tables */
+#define BLOCK_CODES 65536
+
+/* longest Huffman code zip -h writes */
+#define MAX_CODE_LENGTH 12
+
+/* size of the input and output buffers */
+#define BUFFER_SIZE 65536
+
+/* a Huffman decoding table entry: the symbol for the low MAX_CODE_LENGTH bits, and its length */
+struct decode_entry
+{
+    unsigned char symbol;
+    unsigned char length; // 0 if no code starts with these bits
+};
+
+/* where codes come from: 16-bit words, or Huffman coded blocks */
+struct code_reader
+{
+    int fd;
+    int entropy;
+    unsigned char buffer[BUFFER_SIZE];
+    size_t start;  // next unread byte of buffer
+    size_t end;    // end of the valid bytes in buffer
+    unsigned short codes[BLOCK_CODES]; // the decoded block (entropy only)
+    size_t num_codes;
+    size_t next_code;
+    int done;
+};
+
+/* the LZW dictionary: every code past AFTER_ASCII is an earlier code plus one character */
+struct dictionary
+{
+    unsigned short prefix[NUM_CODES];
+    unsigned char suffix[NUM_CODES];
+    unsigned char first[NUM_CODES];  // first character of the string
+    unsigned short length[NUM_CODES];
+};
+
+/* uncompress in_file_name to out_file_name
+ * return 0 on success and 1 on error
+ */
+int uncompress(char *in_file_name, char *out_file_name);
+
+int main(int argc, char **argv)
+{
+    size_t len = argc == 2 ? strlen(argv[1]) : 0;
+    if (argc != 2 || len <= 4 || strcmp(argv[1] + len - 4, ".zip") != 0)
+    {
+        printf("Usage: unzip file.zip\n");
+        exit(1);
+    }
+
+    char *in_file_name = argv[1];
+    char *out_file_name = strdup(in_file_name);
+    if (out_file_name == NULL)
+    {
+        printf("Memory error!");
+        exit(1);
+    }
+    out_file_name[len - 4] = '\0';
+
+    int result = uncompress(in_file_name, out_file_name);
+
+    free(out_file_name);
+
+    return result;
+}
+
+/* make sure at least n bytes are buffered (fewer only at the end of the file)
+ * return the number of bytes available, or -1 on a read error
+ */
+static ssize_t fill(struct code_reader *reader, size_t n)
+{
+    if (reader->end - reader->start >= n)
+    {
+        return reader->end - reader->start;
+    }
+    memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+    reader->end -= reader->start;
+    reader->start = 0;
+    while (reader->end < n)
+    {
+        ssize_t successfully_read = read(reader->fd, reader->buffer + reader->end, BUFFER_SIZE - reader->end);
+        if (successfully_read == -1)
+        {
+            return -1;
+        }
+        if (successfully_read == 0)
+        {
+            break;
+        }
+        reader->end += successfully_read;
+    }
+    return reader->end;
+}
+
+/* read a 32-bit little-endian number
+ * return 0 on success and -1 on a read error or a short file
+ */
+static int read_u32(struct code_reader *reader, unsigned int *n)
+{
+    if (fill(reader, 4) < 4)
+    {
+        return -1;
+    }
+    unsigned char *p = reader->buffer + reader->start;
+    *n = p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+    reader->start += 4;
+    return 0;
+}
+
+/* build the table that decodes the symbol at the low MAX_CODE_LENGTH bits in one lookup
+ * return 0 on success and -1 if the lengths don't describe a valid code
+ */
+static int build_table(unsigned char *lengths, struct decode_entry *table)
+{
+    int count[MAX_CODE_LENGTH + 1] = {0};
+    int next[MAX_CODE_LENGTH + 1];
+    for (int i = 0; i < 256; i++)
+    {
+        if (lengths[i] > MAX_CODE_LENGTH)
+        {
+            return -1;
+        }
+        count[lengths[i]]++;
+    }
+    count[0] = 0;
+    int code = 0;
+    for (int len = 1; len <= MAX_CODE_LENGTH; len++)
+    {
+        code = (code + count[len - 1]) << 1;
+        next[len] = code;
+    }
+    memset(table, 0, (1 << MAX_CODE_LENGTH) * sizeof(struct decode_entry));
+    for (int i = 0; i < 256; i++)
+    {
+        int len = lengths[i];
+        if (len == 0)
+        {
+            continue;
+        }
+        int c = next[len]++;
+        if (c >= (1 << len))
+        {
+            return -1;
+        }
+        int reversed = 0;
+        for (int b = 0; b < len; b++)
+        {
+            reversed = (reversed << 1) | ((c >> b) & 1);
+        }
+        // every index whose low len bits are this code decodes to symbol i
+        for (int j = reversed; j < (1 << MAX_CODE_LENGTH); j += 1 << len)
+        {
+            table[j].symbol = i;
+            table[j].length = len;
+        }
+    }
+    return 0;
+}
+
+/* read and decode the next Huffman coded block into reader->codes
+ * return 0 on success and -1 on a read error or a corrupt file
+ */
+static int read_block(struct code_reader *reader)
+{
+    static struct decode_entry high_table[1 << MAX_CODE_LENGTH];
+    static struct decode_entry low_table[1 << MAX_CODE_LENGTH];
+    unsigned int num_codes, size;
+    if (read_u32(reader, &num_codes) != 0 || num_codes > BLOCK_CODES)
+    {
+        return -1;
+    }
+    reader->num_codes = num_codes;
+    reader->next_code = 0;
+    if (num_codes == 0)
+    {
+        reader->done = 1;
+        return 0;
+    }
+    if (fill(reader, 256) < 256)
+    {
+        return -1;
+    }
+    unsigned char high_lengths[256], low_lengths[256];
+    unsigned char *packed = reader->buffer + reader->start;
+    for (int i = 0; i < 128; i++)
+    {
+        high_lengths[2 * i] = packed[i] & 0xf;
+        high_lengths[2 * i + 1] = packed[i] >> 4;
+        low_lengths[2 * i] = packed[128 + i] & 0xf;
+        low_lengths[2 * i + 1] = packed[128 + i] >> 4;
+    }
+    reader->start += 256;
+    if (build_table(high_lengths, high_table) != 0 || build_table(low_lengths, low_table) != 0)
+    {
+        return -1;
+    }
+    if (read_u32(reader, &size) != 0 || size > (unsigned int)num_codes * 2 * MAX_CODE_LENGTH / 8 + 8)
+    {
+        return -1;
+    }
+
+    // bits are consumed from the bottom of a 64-bit buffer that is refilled a byte at a time
+    unsigned long long bits = 0;
+    int num_bits = 0;
+    unsigned int remaining = size;
+    unsigned int mask = (1 << MAX_CODE_LENGTH) - 1;
+    for (unsigned int i = 0; i < num_codes; i++)
+    {
+        while (num_bits <= 56 && remaining > 0)
+        {
+            if (reader->start == reader->end && fill(reader, 1) <= 0)
+            {
+                return -1;
+            }
+            bits |= (unsigned long long)reader->buffer[reader->start++] << num_bits;
+            num_bits += 8;
+            remaining--;
+        }
+        struct decode_entry high = high_table[bits & mask];
+        if (high.length == 0 || high.length > num_bits)
+        {
+            return -1;
+        }
+        bits >>= high.length;
+        num_bits -= high.length;
+        struct decode_entry low = low_table[bits & mask];
+        if (low.length == 0 || low.length > num_bits)
+        {
+            return -1;
+        }
+        bits >>= low.length;
+        num_bits -= low.length;
+        reader->codes[i] = (unsigned short)((high.symbol << 8) | low.symbol);
+    }
+    // skip any padding bytes the loop didn't need
+    while (remaining > 0)
+    {
+        if (reader->start == reader->end && fill(reader, 1) <= 0)
+        {
+            return -1;
+        }
+        reader->start++;
+        remaining--;
+    }
+    return 0;
+}
+
+/* get the next code
+ * return 1 if there is one, 0 at the end of the file, and -1 on error
+ */
+static int next_code(struct code_reader *reader, unsigned int *code)
+{
+    if (!reader->entropy)
+    {
+        ssize_t available = fill(reader, 2);
+        if (available < 0)
+        {
+            return -1;
+        }
+        if (available < 2)
+        {
+            return available == 0 ? 0 : -1;
+        }
+        unsigned char *p = reader->buffer + reader->start;
+        *code = p[0] | (p[1] << 8);
+        reader->start += 2;
+        return 1;
+    }
+    while (reader->next_code == reader->num_codes)
+    {
+        if (reader->done)
+        {
+            return 0;
+        }
+        if (read_block(reader) != 0)
+        {
+            return -1;
+        }
+    }
+    *code = reader->codes[reader->next_code++];
+    return 1;
+}
+
+/* uncompress in_file_name to out_file_name */
+int uncompress(char *in_file_name, char *out_file_name)
+{
+    struct code_reader *reader = (struct code_reader *)malloc(sizeof(struct code_reader));
+    struct dictionary *dict = (struct dictionary *)malloc(sizeof(struct dictionary));
+    unsigned char *out = (unsigned char *)malloc(BUFFER_SIZE + NUM_CODES);
+    if (reader == NULL || dict == NULL || out == NULL)
+    {
+        printf("Memory error!");
+        free(reader);
+        free(dict);
+        free(out);
+        return 1;
+    }
+    int fd_in = open(in_file_name, O_RDONLY);
+    if (fd_in == -1)
+    {
+        perror(in_file_name);
+        free(reader);
+        free(dict);
+        free(out);
+        return 1;
+    }
+    int fd_out = open(out_file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd_out == -1)
+    {
+        perror(out_file_name);
+        close(fd_in);
+        free(reader);
+        free(dict);
+        free(out);
+        return 1;
+    }
+    reader->fd = fd_in;
+    reader->start = reader->end = 0;
+    reader->num_codes = reader->next_code = 0;
+    reader->done = 0;
+    size_t magic_len = strlen(HUFFMAN_MAGIC);
+    ssize_t available = fill(reader, magic_len);
+    reader->entropy = available >= (ssize_t)magic_len
+                      && memcmp(reader->buffer, HUFFMAN_MAGIC, magic_len) == 0;
+    if (reader->entropy)
+    {
+        reader->start += magic_len;
+    }
+
+    // initialize dictionary to hold first 256 chars
+    for (int i = 0; i < AFTER_ASCII; i++)
+    {
+        dict->suffix[i] = i;
+        dict->first[i] = i;
+        dict->length[i] = 1;
+    }
+    int result = available < 0 ? -1 : 0;
+    unsigned int index = AFTER_ASCII;
+    unsigned int prev = NUM_CODES;
+    unsigned int code;
+    size_t out_size = 0;
+    while (result == 0 && (result = next_code(reader, &code)) == 1)
+    {
+        result = 0;
+        // the code may be the one about to be added (the string prev + its own first char)
+        if (code > index || (code == index && (prev == NUM_CODES || index == NUM_CODES)))
+        {
+            result = -1;
+            break;
+        }
+        if (prev != NUM_CODES && index < NUM_CODES)
+        {
+            dict->prefix[index] = prev;
+            dict->first[index] = dict->first[prev];
+            dict->suffix[index] = code == index ? dict->first[prev] : dict->first[code];
+            dict->length[index] = dict->length[prev] + 1;
+            index++;
+        }
+        prev = code;
+
+        // write the string for code backwards from its last character
+        unsigned int len = dict->length[code];
+        unsigned char *p = out + out_size + len;
+        unsigned int c = code;
+        while (c >= AFTER_ASCII)
+        {
+            *--p = dict->suffix[c];
+            c = dict->prefix[c];
+        }
+        *--p = (unsigned char)c;
+        out_size += len;
+        if (out_size >= BUFFER_SIZE)
+        {
+            if (write(fd_out, out, out_size) != (ssize_t)out_size)
+            {
+                perror(out_file_name);
+                result = -1;
+            }
+            out_size = 0;
+        }
+    }
+    if (result == 0 && out_size > 0 && write(fd_out, out, out_size) != (ssize_t)out_size)
+    {
+        perror(out_file_name);
+        result = -1;
+    }
+    if (result == -1)
+    {
+        fprintf(stderr, "%s: corrupt or unreadable file\n", in_file_name);
+    }
+    if (close(fd_in) < 0)
+    {
+        perror(in_file_name);
+    }
+    if (close(fd_out) < 0)
+    {
+        perror(out_file_name);
+    }
+    free(reader);
+    free(dict);
+    free(out);
+    return result == -1 ? 1 : 0;
+}
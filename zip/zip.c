@@ -14,6 +14,36 @@
 /* Index 256, which is the first index after the ASCII dictionary entries */
 #define AFTER_ASCII 256
 
+/* An entropy-coded file starts with this magic number. A plain file starts with
+ * the code for a single character, which is always < AFTER_ASCII, so the first
+ * two bytes of a plain file ("LZ" would be code 0x5a4c) can never match it */
+#define HUFFMAN_MAGIC "LZWH"
+
+/* number of codes Huffman coded together with one pair of tables */
+#define BLOCK_CODES 65536
+
+/* longest Huffman code, so unzip can decode with a single table lookup */
+#define MAX_CODE_LENGTH 12
+
+/* where codes go: straight to the file as 16-bit words, or into blocks that are
+ * Huffman coded before being written
+ * each block is: the number of codes (32 bits), the code lengths for the high
+ * and low bytes of the codes (256 + 256 4-bit lengths), the number of payload
+ * bytes (32 bits), then the payload; a block of 0 codes ends the file
+ */
+struct code_writer
+{
+    int fd;
+    int entropy;
+    size_t count;
+};
+
+/* the codes in the block being built */
+static unsigned short block_codes[BLOCK_CODES];
+
+/* room for every code in a block at the longest code lengths */
+static unsigned char block_payload[BLOCK_CODES * 2 * MAX_CODE_LENGTH / 8 + 8];
+
 /* allocate space for and return a new string s+t */
 char *strappend_str(char *s, char *t);
 
@@ -27,23 +57,33 @@ char *strappend_char(char *s, char c);
 unsigned int find_encoding(char *dictionary[], char *s);
 
 /* write the code for string s to file */
-void write_code(int fd, char *dictionary[], char *s);
+void write_code(struct code_writer *writer, char *dictionary[], char *s);
 
-/* compress in_file_name to out_file_name */
-void compress(char *in_file_name, char *out_file_name);
+/* Huffman code the buffered block of codes and write it out */
+void flush_block(struct code_writer *writer);
+
+/* write anything still buffered and the end of the file */
+void finish_codes(struct code_writer *writer);
+
+/* compress in_file_name to out_file_name
+ * entropy is set to Huffman code the LZW codes
+ */
+void compress(char *in_file_name, char *out_file_name, int entropy);
 
 int main(int argc, char **argv)
 {
-    if (argc != 2)
+    int entropy = argc == 3 && strcmp(argv[1], "-h") == 0;
+    if (argc != 2 && !entropy)
     {
-        printf("Usage: zip file\n");
+        printf("Usage: zip [-h] file\n");
+        printf("       -h    Huffman code the compressed output\n");
         exit(1);
     }
 
-    char *in_file_name = argv[1];
+    char *in_file_name = argv[argc - 1];
     char *out_file_name = strappend_str(in_file_name, ".zip");
 
-    compress(in_file_name, out_file_name);
+    compress(in_file_name, out_file_name, entropy);
 
     /* have to free the memory for out_file_name since strappend_str malloc()'ed it */
     free(out_file_name);
@@ -114,8 +154,24 @@ unsigned int find_encoding(char *dictionary[], char *s)
     return NUM_CODES;
 }
 
+/* write all of buffer to fd, exiting on error */
+static void write_all(int fd, void *buffer, size_t size)
+{
+    if (write(fd, buffer, size) != (ssize_t)size)
+    {
+        perror("write");
+        exit(1);
+    }
+}
+
+static void write_u32(int fd, unsigned int n)
+{
+    unsigned char bytes[4] = {n & 0xff, (n >> 8) & 0xff, (n >> 16) & 0xff, (n >> 24) & 0xff};
+    write_all(fd, bytes, 4);
+}
+
 /* write the code for string s to file */
-void write_code(int fd, char *dictionary[], char *s)
+void write_code(struct code_writer *writer, char *dictionary[], char *s)
 {
     if (dictionary == NULL || s == NULL)
     {
@@ -132,15 +188,227 @@ void write_code(int fd, char *dictionary[], char *s)
 
     // cast the code to an unsigned short to only use 16 bits per code word in the output file
     unsigned short actual_code = (unsigned short)code;
-    if (write(fd, &actual_code, sizeof(unsigned short)) != sizeof(unsigned short))
+    if (writer->entropy)
     {
-        perror("write");
-        exit(1);
+        block_codes[writer->count++] = actual_code;
+        if (writer->count == BLOCK_CODES)
+        {
+            flush_block(writer);
+        }
+        return;
+    }
+    write_all(writer->fd, &actual_code, sizeof(unsigned short));
+}
+
+/* find Huffman code lengths of at most MAX_CODE_LENGTH bits for the 256 symbols with
+ * the given frequencies; unused symbols get length 0
+ */
+static void huffman_lengths(unsigned int *freq, unsigned char *lengths)
+{
+    unsigned int weight[512];
+    int parent[512];
+    int alive[512];
+    unsigned int scaled[256];
+    int used = 0;
+    for (int i = 0; i < 256; i++)
+    {
+        scaled[i] = freq[i];
+        lengths[i] = 0;
+        if (freq[i] > 0)
+        {
+            used++;
+        }
+    }
+    if (used == 0)
+    {
+        return;
+    }
+    if (used == 1)
+    {
+        for (int i = 0; i < 256; i++)
+        {
+            if (freq[i] > 0)
+            {
+                lengths[i] = 1;
+            }
+        }
+        return;
+    }
+
+    while (1)
+    {
+        // build the tree by repeatedly joining the two lightest nodes
+        int nodes = 256;
+        for (int i = 0; i < 256; i++)
+        {
+            weight[i] = scaled[i];
+            alive[i] = scaled[i] > 0;
+            parent[i] = -1;
+        }
+        for (int joined = 1; joined < used; joined++)
+        {
+            int a = -1, b = -1;
+            for (int i = 0; i < nodes; i++)
+            {
+                if (!alive[i])
+                {
+                    continue;
+                }
+                if (a == -1 || weight[i] < weight[a])
+                {
+                    b = a;
+                    a = i;
+                }
+                else if (b == -1 || weight[i] < weight[b])
+                {
+                    b = i;
+                }
+            }
+            weight[nodes] = weight[a] + weight[b];
+            alive[nodes] = 1;
+            parent[nodes] = -1;
+            alive[a] = alive[b] = 0;
+            parent[a] = parent[b] = nodes;
+            nodes++;
+        }
+
+        int longest = 0;
+        for (int i = 0; i < 256; i++)
+        {
+            if (scaled[i] == 0)
+            {
+                continue;
+            }
+            int depth = 0;
+            for (int n = i; parent[n] != -1; n = parent[n])
+            {
+                depth++;
+            }
+            lengths[i] = depth;
+            if (depth > longest)
+            {
+                longest = depth;
+            }
+        }
+        if (longest <= MAX_CODE_LENGTH)
+        {
+            return;
+        }
+        // too deep, so flatten the frequencies and try again
+        for (int i = 0; i < 256; i++)
+        {
+            if (scaled[i] > 0)
+            {
+                scaled[i] = (scaled[i] + 1) / 2;
+            }
+        }
+    }
+}
+
+/* assign canonical Huffman codes for lengths, bit-reversed since bits are written LSB first */
+static void huffman_codes(unsigned char *lengths, unsigned short *codes)
+{
+    int count[MAX_CODE_LENGTH + 1] = {0};
+    int next[MAX_CODE_LENGTH + 1];
+    for (int i = 0; i < 256; i++)
+    {
+        count[lengths[i]]++;
+    }
+    count[0] = 0;
+    int code = 0;
+    for (int len = 1; len <= MAX_CODE_LENGTH; len++)
+    {
+        code = (code + count[len - 1]) << 1;
+        next[len] = code;
+    }
+    for (int i = 0; i < 256; i++)
+    {
+        int len = lengths[i];
+        if (len == 0)
+        {
+            continue;
+        }
+        int c = next[len]++;
+        int reversed = 0;
+        for (int b = 0; b < len; b++)
+        {
+            reversed = (reversed << 1) | ((c >> b) & 1);
+        }
+        codes[i] = (unsigned short)reversed;
+    }
+}
+
+/* Huffman code the buffered block of codes and write it out */
+void flush_block(struct code_writer *writer)
+{
+    if (writer->count == 0)
+    {
+        return;
+    }
+    // the high and low bytes of the codes each get their own table
+    unsigned int high_freq[256] = {0};
+    unsigned int low_freq[256] = {0};
+    for (size_t i = 0; i < writer->count; i++)
+    {
+        high_freq[block_codes[i] >> 8]++;
+        low_freq[block_codes[i] & 0xff]++;
+    }
+    unsigned char high_lengths[256], low_lengths[256];
+    unsigned short high_codes[256], low_codes[256];
+    huffman_lengths(high_freq, high_lengths);
+    huffman_lengths(low_freq, low_lengths);
+    huffman_codes(high_lengths, high_codes);
+    huffman_codes(low_lengths, low_codes);
+
+    unsigned char packed_lengths[256];
+    for (int i = 0; i < 128; i++)
+    {
+        packed_lengths[i] = high_lengths[2 * i] | (high_lengths[2 * i + 1] << 4);
+        packed_lengths[128 + i] = low_lengths[2 * i] | (low_lengths[2 * i + 1] << 4);
+    }
+
+    unsigned long long bits = 0;
+    int num_bits = 0;
+    size_t size = 0;
+    for (size_t i = 0; i < writer->count; i++)
+    {
+        int high = block_codes[i] >> 8;
+        int low = block_codes[i] & 0xff;
+        bits |= (unsigned long long)high_codes[high] << num_bits;
+        num_bits += high_lengths[high];
+        bits |= (unsigned long long)low_codes[low] << num_bits;
+        num_bits += low_lengths[low];
+        while (num_bits >= 8)
+        {
+            block_payload[size++] = bits & 0xff;
+            bits >>= 8;
+            num_bits -= 8;
+        }
+    }
+    if (num_bits > 0)
+    {
+        block_payload[size++] = bits & 0xff;
+    }
+
+    write_u32(writer->fd, writer->count);
+    write_all(writer->fd, packed_lengths, sizeof(packed_lengths));
+    write_u32(writer->fd, size);
+    write_all(writer->fd, block_payload, size);
+    writer->count = 0;
+}
+
+/* write anything still buffered and the end of the file */
+void finish_codes(struct code_writer *writer)
+{
+    if (writer->entropy)
+    {
+        flush_block(writer);
+        write_u32(writer->fd, 0);
     }
 }
 
 /* compress in_file_name to out_file_name */
-void compress(char *in_file_name, char *out_file_name)
+void compress(char *in_file_name, char *out_file_name, int entropy)
 {
     // initialize dictionary to hold first 256 chars
     char *dictionary[NUM_CODES];
@@ -171,7 +439,6 @@ void compress(char *in_file_name, char *out_file_name)
     char *current_string;
     char current_char;
     char *new_string;
-    int str_reassigned_flag = 0;
     ssize_t successfully_read;
     unsigned int encoding;
     int index = AFTER_ASCII;
@@ -199,6 +466,11 @@ void compress(char *in_file_name, char *out_file_name)
         }
         return;
     }
+    struct code_writer writer = {fd_out, entropy, 0};
+    if (entropy)
+    {
+        write_all(fd_out, HUFFMAN_MAGIC, strlen(HUFFMAN_MAGIC));
+    }
     successfully_read = read(fd_in, &current_char, 1);
     if (successfully_read == -1)
     {
@@ -217,6 +489,24 @@ void compress(char *in_file_name, char *out_file_name)
         }
         return;
     }
+    if (successfully_read == 0)
+    {
+        // an empty file compresses to no codes at all
+        finish_codes(&writer);
+        for (int i = 0; i < index; i++)
+        {
+            free(dictionary[i]);
+        }
+        if (close(fd_in) < 0)
+        {
+            perror(in_file_name);
+        }
+        if (close(fd_out) < 0)
+        {
+            perror(out_file_name);
+        }
+        return;
+    }
     current_string = (char *)malloc(2*sizeof(char));
     if (current_string == NULL)
     {
@@ -263,16 +553,20 @@ void compress(char *in_file_name, char *out_file_name)
         {
             free(current_string);
             current_string = new_string;
-            str_reassigned_flag = 1;
         }
         else
         {   
-            write_code(fd_out, dictionary, current_string);
+            write_code(&writer, dictionary, current_string);
             if (index < NUM_CODES)
             {
                 dictionary[index] = new_string;
                 index++;
             }
+            else
+            {
+                // the dictionary is full, so new_string isn't kept anywhere
+                free(new_string);
+            }
             current_string[0] = current_char;
             current_string[1] = '\0';
         }
@@ -294,16 +588,13 @@ void compress(char *in_file_name, char *out_file_name)
         }
         return;
     }
-    write_code(fd_out, dictionary, current_string);
+    write_code(&writer, dictionary, current_string);
+    finish_codes(&writer);
     for (int i = 0; i < index; i++)
     {   
         free(dictionary[i]);
     }    
     free(current_string);
-    if (!str_reassigned_flag)
-    {
-        free(new_string);
-    }
     if (close(fd_in) < 0)
     {
         perror(in_file_name);